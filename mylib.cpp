@@ -1,991 +1,1519 @@
-#include <iostream>
-#include <fstream>
-#include <cstring>
-#include <string>
-#include <unordered_map>
-#include <map>
-#include <set>
-#include <algorithm>
-#include <functional>
-#include <thread>
-#include <cstdlib>
-#include <memory>
-
-#include <sys/stat.h>
-#include <sys/types.h>
-
-#if defined(_WIN32) || defined(_WIN64)
-/* We are on Windows */
-#include <direct.h>
-#include <windows.h>
-#include <stdio.h>
-#include <tchar.h>
-
-#else
-
-/* We are on Non-Windows */
-#include <unistd.h>
-#define _rmdir rmdir
-#define _mkdir(name) mkdir(name,S_IRWXU)
-#endif
-
-#include "mylib.h"
-
-const int BUFFERINCREMENTSIZE = 2000000;
-const int MAXLINELENGTH = 256;
-const int MAXPARTITION = 256;
-const uint64_t MINFILESIZEFORFILTER = 500000000;	// ~500mb
-const uint64_t BIGFILESIZE = 10000000000;
-
-int G_MMRLen = 10;	//Global version of mmrLen: minimizer length, might need to change the value
-
-
-TopKmerCounting::TopKmerCounting(char *filename, const int givenKmerSize, const int givenTopCount)
-    :kmersize(givenKmerSize), topcount(givenTopCount), // initializer list for const variable members
-    maxLineLenInFile(MAXLINELENGTH), maxPartitionNumber(MAXPARTITION),
-    minimizerHistogramDiv(new float[(1 << (G_MMRLen * 2)) + 1]), sortedMinimizersDiv(new float[(1 << (G_MMRLen * 2)) + 1]),
-    minimizerHistogramFac(new uint32_t[(1 << (G_MMRLen * 2)) + 1]), sortedMinimizersFac(new uint32_t[(1 << (G_MMRLen * 2)) + 1]),
-    minimizerHistogramSum(new uint32_t[(1 << (G_MMRLen * 2)) + 1]), sortedMinimizersSum(new uint32_t[(1 << (G_MMRLen * 2)) + 1])
-{
-    if (givenKmerSize>90 || givenKmerSize<3)
-    {
-        std::cerr << "Warning: kmersize value is only allowed in range 3-90" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    if (givenTopCount<1)
-    {
-        std::cerr << "Warning: topcount value must be bigger than 0" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    fastqFilename = filename;
-    if (givenKmerSize<G_MMRLen && givenKmerSize != 1) // In case kmersize is less than defaul mmrLen
-    {
-        G_MMRLen = givenKmerSize - 1;
-    }
-    if (givenKmerSize == 1)
-    {
-        G_MMRLen = 1;
-    }
-
-    mmrLen = G_MMRLen;
-
-    // 	the parameters below are not really good, with enough time one can get proper
-    //	formula for bigfiles when high topcount is asked
-    if (getSizeofFile(fastqFilename.c_str()) < MINFILESIZEFORFILTER)
-    {
-        maxDepthSearch = (1 << (mmrLen * 2)) - 1;			// To be sure toplist is correct
-        isBigFileEnabled = 0;
-        histogramReadRate = 10;
-    }
-    else {
-        if (topcount<25)
-        {
-            maxDepthSearch = 50;
-        }
-        else {
-            maxDepthSearch = topcount * 2;
-        }
-        isBigFileEnabled = 1;
-        histogramReadRate = 10;
-    }
-
-    if (topcount>1000 && isBigFileEnabled)
-    {
-        isDiskMethodEnabled = 1;
-        maxDepthSearch = topcount * 2;
-        histogramReadRate = 10;
-    }
-    else {
-        isDiskMethodEnabled = 0;
-    }
-
-    if (topcount>1000 && getSizeofFile(fastqFilename.c_str())>BIGFILESIZE)
-    {
-        isDiskMethodEnabled = 1;
-        maxDepthSearch = topcount * 4;
-        histogramReadRate = 5;
-    }
-    else if (getSizeofFile(fastqFilename.c_str())>BIGFILESIZE)
-    {
-        isDiskMethodEnabled = 0;
-        maxDepthSearch = topcount * 4;
-        histogramReadRate = 5;
-    }
-    // 	the parameters above are not really good, with enough time one can get proper
-    //	formula for bigfiles when high topcount is asked. might calculating deviation help?
-
-    if (maxDepthSearch>(1 << (mmrLen * 2)))
-    {
-        maxDepthSearch = (1 << (mmrLen * 2)) - 1;        //In case maxDepthSearch is bigger than border
-    }
-
-    nThreads = std::thread::hardware_concurrency();
-    threadFlag = new int[maxPartitionNumber];
-    for (int i = 0; i<maxPartitionNumber; i++)
-    {
-        threadFlag[i] = 0;					//Initially all partitions are not processed so they are initialized 0
-    }
-
-    myTopCountTable = new std::multimap<int, std::string>[nThreads];			//all threads need its own sorted list before merging
-
-                                                                                //(1<<(mmrLen*2)) is the number of all different minimizers
-
-    for (int i = 0; i <= (1 << (mmrLen * 2)); i++)
-    {
-        minimizerHistogramDiv[i] = 0.0;	minimizerHistogramFac[i] = 0; minimizerHistogramSum[i] = 0;
-    }
-
-    //filtered data must have been allocated by malloc since it realloc will be used
-    filteredData = (char**)malloc(maxPartitionNumber * sizeof(char*));
-    for (int i = 0; i<maxPartitionNumber; i++)
-    {
-        filteredData[i] = (char *)malloc(2 * sizeof(char));    //2 is just a dummy number :)
-    }
-
-    currentBufferSize = new uint32_t[maxPartitionNumber];
-    currentUsedBufferSize = new uint32_t[maxPartitionNumber];
-    for (int i = 0; i<maxPartitionNumber; i++)
-    {
-        currentBufferSize[i] = 0;
-    }
-    for (int i = 0; i<maxPartitionNumber; i++)
-    {
-        currentUsedBufferSize[i] = 0;
-    }
-
-}
-
-TopKmerCounting::~TopKmerCounting() {
-    myTopCountTable[0].clear();				//	others already cleared when combining
-
-    delete[] myTopCountTable;
-    delete[] threadFlag;
-    free(filteredData);						//	others already cleared during counting
-}
-
-void TopKmerCounting::StartCounting() {
-    if (isDiskMethodEnabled)
-    {
-        RunProcessInDISK();
-    }
-    else {
-        RunProcessInRAM();
-    }
-}
-
-void TopKmerCounting::RunProcessInRAM() {
-
-    HistogramProcess();					//Histogram function for minimizers
-
-    //std::cout << "hist done" << std::endl;
-    std::copy_n(minimizerHistogramDiv.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersDiv.get());
-    std::copy_n(minimizerHistogramFac.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersFac.get());
-    std::copy_n(minimizerHistogramSum.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersSum.get());
-
-    //We need sorted histogram for later filtering
-    std::sort(sortedMinimizersDiv.get(), sortedMinimizersDiv.get() + (uint32_t)(1 << (mmrLen * 2)), [](const float x, const float y)->bool {return x > y;});
-    std::sort(sortedMinimizersFac.get(), sortedMinimizersFac.get() + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
-    std::sort(sortedMinimizersSum.get(), sortedMinimizersSum.get() + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
-
-    //All threads will have initialized toplist map with dummy values
-    for (int t = 0; t < nThreads; t++) {
-        for (int i = 0; i < topcount; i++)	myTopCountTable[t].insert(std::make_pair(0 - i, "dummyString"));
-    }
-
-    //std::cout << "partitionProcess" << std::endl;
-
-    partitionProcess();		// by using histograms, file is written into partitions buffer and also filtered
-
-    //all threads will process different filtered partition data and keep always toplist by inserting into their own hashtable
-    std::unique_ptr<std::thread[]> pthrds(new std::thread[nThreads]);
-    std::thread *partitionThreads = pthrds.get();
-    for (int i = 0; i<nThreads; i++) partitionThreads[i] = std::thread([this, i] { this->partition2Table(i); });
-    for (int i = 0; i<nThreads; i++) partitionThreads[i].join();
-
-    // after all threads done, merging toplist maps into myTopCountTable[0]
-    for (int i = 1; i<nThreads; i++)
-    {
-        auto minIt = myTopCountTable[0].begin();
-        int myTopCountTableMin = minIt->first;
-
-        for (auto it = myTopCountTable[i].begin(); it != myTopCountTable[i].end(); ++it)
-        {
-            if (it->first > myTopCountTableMin)
-            {
-                myTopCountTable[0].erase(minIt);
-                myTopCountTable[0].insert(std::make_pair(it->first, it->second));
-                minIt = myTopCountTable[0].begin();
-                myTopCountTableMin = minIt->first;
-            }
-        }
-        myTopCountTable[i].clear();
-    }
-}
-
-void TopKmerCounting::RunProcessInDISK() {
-
-    HistogramProcess();					//Histogram function for minimizers
-
-    //std::cout << "hist done" << std::endl;
-
-    std::copy_n(minimizerHistogramDiv.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersDiv.get());
-    std::copy_n(minimizerHistogramFac.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersFac.get());
-    std::copy_n(minimizerHistogramSum.get(), (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersSum.get());
-
-    //We need sorted histogram for later filtering
-    std::sort(sortedMinimizersDiv.get(), sortedMinimizersDiv.get() + (uint32_t)(1 << (mmrLen * 2)), [](const float x, const float y)->bool {return x > y;});
-    std::sort(sortedMinimizersFac.get(), sortedMinimizersFac.get() + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
-    std::sort(sortedMinimizersSum.get(), sortedMinimizersSum.get() + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
-
-    //All threads will have initialized toplist map with dummy values
-    for (int t = 0; t<nThreads; t++)
-    {
-        for (int i = 0; i < topcount; i++)
-        {
-            myTopCountTable[t].insert(std::make_pair(0 - i, "dummyString"));
-        }
-    }
-
-    //std::cout << "partitionProcess" << std::endl;
-
-    partitionProcessDiskMethod();		// by using histograms, file is written into partitions buffer and also filtered
-
-    //all threads will process different filtered partition data and keep always toplist by inserting into their own hashtable
-    std::unique_ptr<std::thread[]> pthrds(new std::thread[nThreads]);
-    std::thread *partitionThreads = pthrds.get();
-    for (int i = 0; i<nThreads; i++) partitionThreads[i] = std::thread([this,i] { this->partition2TableDiskMethod(i); } );
-    for (int i = 0; i<nThreads; i++) partitionThreads[i].join();
-
-    std::string tempDir;
-    tempDir.append("./temp");
-    remove(tempDir.c_str());
-
-    // after all threads done, merging toplist maps into myTopCountTable[0]
-    for (int i = 1; i<nThreads; i++)
-    {
-        auto minIt = myTopCountTable[0].begin();
-        int myTopCountTableMin = minIt->first;
-
-        for (auto it = myTopCountTable[i].begin(); it != myTopCountTable[i].end(); ++it)
-        {
-            if (it->first > myTopCountTableMin)
-            {
-                myTopCountTable[0].erase(minIt);
-                myTopCountTable[0].insert(std::make_pair(it->first, it->second));
-                minIt = myTopCountTable[0].begin();
-                myTopCountTableMin = minIt->first;
-            }
-        }
-        myTopCountTable[i].clear();
-    }
-}
-
-void TopKmerCounting::DisplayTopList() {
-    for (auto it = myTopCountTable[0].end(); it != myTopCountTable[0].begin(); )
-    {
-        it--;
-        std::cout << it->second << " " << it->first << std::endl;
-    }
-}
-
-
-/**
-* Function:  getMinimizerValue(const char *GSeq, int MinSubPos)
-* It calculates the integer value of a minimizer 				**
-* for given char array and position of minimizer				**
-* 																**
-* 	**************************************************************
-* */
-
-/*
-int getMinimizerValue(const char *GSeq, int MinSubPos){
-int ret_value = 0;
-for(int i=0 ; i<G_MMRLen ; i++){
-ret_value *=4;
-if(GSeq[MinSubPos+i] == 'C')
-ret_value += 1;
-else if(GSeq[MinSubPos+i] == 'G')
-ret_value += 2;
-else if(GSeq[MinSubPos+i] == 'T')
-ret_value += 3;
-}
-return ret_value;
-}
-*/
-
-/**
-int CheckBadMinSubstring(const char *GSeq, int i){
-if(!strncmp(GSeq+i,"AAA",3) || !strncmp(GSeq+i,"ACA",3))
-return 1;
-for(int j=1 ; j<G_MMRLen-1 ; j++)
-if(!strncmp(GSeq+i+j,"AA",2))
-return 1;
-return 0;
-}
-**/
-
-/**
-* Function:	CheckBadMinSubstring(uint64_t )
-* 		Int64 version of CheckBadMinSubstring(const char *GSeq, int i).
-* 		This function checks if given IntString has AAA and ACA prefixes
-*  	and also AA anywhere except beginning of the string
-*
-* */
-
-static int CheckBadMinSubstring(uint64_t nextCand) {
-    if ((nextCand >> ((G_MMRLen - 3) * 2)) == 0 || (nextCand >> ((G_MMRLen - 3) * 2)) == 0x04)
-    {        //Checking AAA and ACA prefix
-        return 1;
-    }
-    for (int i = 2; i<(G_MMRLen); i++) {													//Checking AA if it anywhere except beginning
-        if ((nextCand & 0xf) == 0)
-        {
-            return 1;
-        }
-        nextCand >>= 2;
-    }
-    return 0;
-}
-
-
-/**
-* 	Function:  CompareLastPSubstringWithMin(const uint64_t *, int, int ,uint64_t &, uint64_t &)
-*
-* 	This function check if the last G_MMRLen length substring
-* 	is a new minimizer after shifting string one letter
-*
-* */
-
-static int CompareLastPSubstringWithMin(const uint64_t *GSeq, int endPos, int MinSubPos, uint64_t &minCand, uint64_t &nextCand) {
-    int leftSideBitLen = (((endPos - G_MMRLen) & 0x1f) * 2);
-    int intIndex = (endPos - G_MMRLen) >> 5;
-    if ((64 - leftSideBitLen) >= (G_MMRLen * 2))
-    {
-        nextCand = (GSeq[intIndex] >> (64 - leftSideBitLen - (G_MMRLen * 2))) & andTable[(G_MMRLen * 2)];
-    }
-    else {
-        nextCand = (GSeq[intIndex] & andTable[(64 - leftSideBitLen)]);
-        nextCand = (nextCand << (((G_MMRLen * 2) + leftSideBitLen) - 64)) ^
-            (GSeq[intIndex + 1] >> (128 - ((G_MMRLen * 2) + leftSideBitLen)));
-    }
-    if (minCand > nextCand)
-    {
-        if (CheckBadMinSubstring(nextCand))
-        {
-            return 0;
-        }
-        return 1;
-    }
-    return 0;
-}
-
-/**
-int findMinimumPSubstring(const char *GSeq, int startPos, int endPos){
-int MinSubPos = startPos;
-for(int i=startPos+1 ; i<=endPos-G_MMRLen ; i++){
-for(int j=0 ; j<G_MMRLen ; j++){
-if(GSeq[MinSubPos+j] < GSeq[i+j])
-break;
-else
-if(GSeq[MinSubPos+j] > GSeq[i+j]){
-if(CheckBadMinSubstring(GSeq, i))
-break;
-MinSubPos=i;
-break;
-}
-}
-}
-return MinSubPos;
-}
-**/
-
-/**
-* Function:  findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue)
-* This function is the 64bit integer version of findMinimumPSubstring above.
-* for given int64 array, by shifting 2 bits i.e. one letter, all substrings are checked one by one
-* faster than char version
-* it is a little hard to understand the conversion
-* indices are so complex because when a minimizer is in two int64, one needs to shift both int64 correctly
-* */
-
-static int findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue) {
-    int MinSubPos = startPos;
-    uint64_t minCand, nextCand;
-    int leftSideBitLen = ((MinSubPos & 0x1f) * 2);
-    int intIndex = (MinSubPos) >> 5;
-    if ((64 - leftSideBitLen) >= (G_MMRLen * 2))
-    {
-        minCand = (GSeq[intIndex] >> (64 - leftSideBitLen - (G_MMRLen * 2))) & andTable[(G_MMRLen * 2)];
-    }
-    else {
-        minCand = GSeq[intIndex] & andTable[(64 - leftSideBitLen)];
-        minCand = (minCand << (((G_MMRLen * 2) + leftSideBitLen) - 64)) ^
-            (GSeq[intIndex + 1] >> (128 - ((G_MMRLen * 2) + leftSideBitLen)));
-    }
-
-    for (int i = startPos + 1; i <= endPos - G_MMRLen; i++) {
-        leftSideBitLen = ((i & 0x1f) * 2);
-        intIndex = i >> 5;
-        if ((64 - leftSideBitLen) >= (G_MMRLen * 2))
-        {
-            nextCand = (GSeq[intIndex] >> (64 - leftSideBitLen - (G_MMRLen * 2))) & andTable[(G_MMRLen * 2)];
-        }
-        else {
-            nextCand = (GSeq[intIndex] & andTable[(64 - leftSideBitLen)]);
-            nextCand = (nextCand << (((G_MMRLen * 2) + leftSideBitLen) - 64)) ^
-                (GSeq[intIndex + 1] >> (128 - ((G_MMRLen * 2) + leftSideBitLen)));
-        }
-        if (minCand > nextCand)
-        {
-            if (CheckBadMinSubstring(nextCand))
-            {
-                continue;
-            }
-            MinSubPos = i;
-            minCand = nextCand;
-        }
-    }
-    MinimizerValue = minCand;
-    return MinSubPos;
-}
-
-
-/**
-* Function:	convertStringToInt64(const char *, uint64_t *)
-* This function converts given string into int64 arrays and fills the empty array
-* A=00	C=01	G=10	T=11
-* */
-
-static void convertStringToInt64(const char *GSeq, uint64_t *GSeqInt) {
-    int char_len = (int)strlen(GSeq);
-    int intArrayEnd = ((char_len + 31) >> 5);
-    for (int i = 0; i<intArrayEnd; i++) GSeqInt[i] = 0;
-    for (int i = 0; i<char_len; i++)
-    {
-        GSeqInt[i >> 5] = (GSeqInt[i >> 5] << 2) + char2IntTable[GSeq[i] - 'A'];
-    }
-
-    for (int i = 0; i<(32 - (char_len & 0x1f)); i++)
-    {
-        GSeqInt[char_len >> 5] = (GSeqInt[char_len >> 5] << 2);
-    }
-}
-
-/**
-* Function:	convertInt64ToString(const uint64_t *, char *, int )
-* This functions converts given int64 array into char string
-* 00=A	01=C	10=G	11=T
-* */
-
-void convertInt64ToString(const uint64_t *GSeqInt, char *GSeq, int char_len) {
-    for (int i = 0; i<char_len; i++)
-    {
-        GSeq[i] = Int2charTable[((GSeqInt[i >> 5] >> (62 - ((i & 0x1f) << 1))) & 0x3)] + 'A';
-    }
-    GSeq[char_len] = '\0';
-}
-
-/**
-* Function:	copySkmerToBuffer(char *, int , int , uint64_t &)
-* This function copy superkmer into buffer in a custom way
-* adding delimiter char '_' between superkmers and at the end there is null character
-* eg.
-* AAAAACTGCTCGTATTATTCG_ACATCATCTATCACTATCTATCTATC\0
-* when a new superkmer added, this is what happens
-* AAAAACTGCTCGTATTATTCG_ACATCATCTATCACTATCTATCTATC_TATCTATCTACTTATCT\0
-* */
-
-void TopKmerCounting::copySkmerToBuffer(char *myline, int startpos, int endpos, uint64_t &MinimizerValue) {
-    uint32_t partNumber = ((uint32_t)MinimizerValue) % this->maxPartitionNumber;
-    if (this->currentBufferSize[partNumber] > this->currentUsedBufferSize[partNumber] + endpos - startpos + 4)
-    {
-        strncpy(this->filteredData[partNumber] + this->currentUsedBufferSize[partNumber], myline + startpos, endpos - startpos + 1);
-        this->filteredData[partNumber][this->currentUsedBufferSize[partNumber] + endpos - startpos + 1] = '_';
-        this->currentUsedBufferSize[partNumber] = this->currentUsedBufferSize[partNumber] + endpos - startpos + 2;
-    }
-    else {
-        this->filteredData[partNumber] = (char*)realloc(this->filteredData[partNumber], (this->currentBufferSize[partNumber] + BUFFERINCREMENTSIZE) * sizeof(char));
-        this->currentBufferSize[partNumber] += BUFFERINCREMENTSIZE;
-        strncpy(this->filteredData[partNumber] + this->currentUsedBufferSize[partNumber], myline + startpos, endpos - startpos + 1);
-        this->filteredData[partNumber][this->currentUsedBufferSize[partNumber] + endpos - startpos + 1] = '_';
-        this->currentUsedBufferSize[partNumber] = this->currentUsedBufferSize[partNumber] + endpos - startpos + 2;
-    }
-    this->filteredData[partNumber][this->currentUsedBufferSize[partNumber]] = '\0';
-}
-
-/**
-* This function opens the fastqfile and read one line each time, calculate minimizers and check histograms
-* and then if it is in the range, superkmer including that minimizer will be written into buffers
-* */
-
-void TopKmerCounting::partitionProcess() {
-
-    std::ifstream MyFile;
-    MyFile.open(this->fastqFilename, std::ifstream::in);
-
-    if (!MyFile)
-    {
-        std::cerr << "Error opening " << this->fastqFilename << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    std::unique_ptr<char[]> shrdmyline(new char[this->maxLineLenInFile]);
-    char * myline = shrdmyline.get();
-    std::unique_ptr<uint64_t[]> shrdmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]);
-    uint64_t *myIntLine = shrdmyIntLine.get();
-
-    MyFile.ignore(MAXLINELENGTH, '\n');
-    MyFile.getline(myline, this->maxLineLenInFile);
-
-    int line_len;
-
-    uint64_t MinimizerValue, nextCandMin;
-
-    do {
-        line_len = (int)strlen(myline);
-        if (strspn(myline, "ACGT") != line_len)
-        {
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.getline(myline, this->maxLineLenInFile);
-            continue;
-        }
-        convertStringToInt64(myline, myIntLine);
-        int min_pos = findMinimumPSubstring(myIntLine, 0, this->kmersize, MinimizerValue);
-        int next_min_pos;
-        int SKmerPosStart = 0;
-        int SKmerPosEnd = this->kmersize - 1;
-        for (int i = 1; i<line_len - this->kmersize + 1; i++)
-        {
-            if (i>min_pos)
-            {
-                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-                {
-                    next_min_pos = findMinimumPSubstring(myIntLine, i, i + this->kmersize, nextCandMin);
-                    if (nextCandMin == MinimizerValue)
-                    {
-                        min_pos = next_min_pos;
-                        SKmerPosEnd++;
-                        continue;
-                    }
-                    copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
-                }
-                SKmerPosStart = i;
-                min_pos = findMinimumPSubstring(myIntLine, i, i + this->kmersize, MinimizerValue);
-
-            }
-            else if (CompareLastPSubstringWithMin(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
-            {
-                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-                {
-                    copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
-                }
-                SKmerPosStart = i;
-                MinimizerValue = nextCandMin;
-                min_pos = i + this->kmersize - this->mmrLen;
-
-            }
-            SKmerPosEnd++;
-        }
-        if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-            (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-            (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-        {
-            copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
-        }
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.getline(myline, this->maxLineLenInFile);
-
-    } while (MyFile.good());
-    MyFile.close();
-}
-
-
-/**
-* This function opens the fastqfile and read one line each time, calculate minimizers and check histograms
-* and then if it is in the range, superkmer including that minimizer will be written into files
-* */
-
-void TopKmerCounting::partitionProcessDiskMethod() {
-    char buffer[100];
-    std::string tempDir;
-    tempDir.append("./temp");
-    std::string binFileName("/kmer");
-    _rmdir(tempDir.c_str());
-
-    if (_mkdir(tempDir.c_str()) != 0)
-    {
-        std::cerr << "Permission Denied for MKDIR" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    std::ifstream MyFile;
-    std::unique_ptr<std::ofstream[]> shrbinfile(new std::ofstream[this->maxPartitionNumber]);
-    std::ofstream *BinFile = shrbinfile.get();
-    for (int f = 0; f<this->maxPartitionNumber; f++)
-    {
-        sprintf(buffer, "%s%s%d.txt", tempDir.c_str(), binFileName.c_str(), f);
-        BinFile[f].open(buffer, std::ifstream::trunc);
-    }
-
-    MyFile.open(this->fastqFilename, std::ifstream::in);
-
-    if (!MyFile)
-    {
-        std::cerr << "Error opening " << this->fastqFilename << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    std::unique_ptr<char[]> shrmyline(new char[this->maxLineLenInFile]);
-    char * myline = shrmyline.get();
-    std::unique_ptr<uint64_t[]> shrmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]);
-    uint64_t *myIntLine = shrmyIntLine.get();
-
-    MyFile.ignore(MAXLINELENGTH, '\n');
-    MyFile.getline(myline, this->maxLineLenInFile);
-
-    int line_len;
-
-    uint64_t MinimizerValue, nextCandMin;
-    do {
-        line_len = (int)strlen(myline);
-        if (strspn(myline, "ACGT") != line_len)
-        {
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.getline(myline, this->maxLineLenInFile);
-            continue;
-        }
-        convertStringToInt64(myline, myIntLine);
-        int min_pos = findMinimumPSubstring(myIntLine, 0, this->kmersize, MinimizerValue);
-        int SKmerPosStart = 0;
-        int SKmerPosEnd = this->kmersize - 1;
-        for (int i = 1; i<line_len - this->kmersize + 1; i++)
-        {
-            if (i>min_pos)
-            {
-                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-                {
-                    BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write(myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1);
-                    BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write("\n", 1);
-                }
-                SKmerPosStart = i;
-                min_pos = findMinimumPSubstring(myIntLine, i, i + this->kmersize, MinimizerValue);
-
-            }
-            else if (CompareLastPSubstringWithMin(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
-            {
-                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-                {
-                    BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write(myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1);
-                    BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write("\n", 1);
-                }
-                SKmerPosStart = i;
-                MinimizerValue = nextCandMin;
-                min_pos = i + this->kmersize - this->mmrLen;
-
-            }
-            SKmerPosEnd++;
-        }
-        if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
-            (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
-            (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
-        {
-            BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write(myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1);
-            BinFile[((uint32_t)MinimizerValue) % this->maxPartitionNumber].write("\n", 1);
-        }
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.ignore(MAXLINELENGTH, '\n');
-        MyFile.getline(myline, this->maxLineLenInFile);
-    } while (MyFile.good());
-
-    for (int f = 0; f<this->maxPartitionNumber; f++)
-    {
-        sprintf(buffer, "%s%s%d.txt", tempDir.c_str(), binFileName.c_str(), f);
-        BinFile[f].close();
-    }
-    MyFile.close();
-}
-
-
-
-/**
-* Function:	HashTableProcess(int , int )
-* This function run by different threads and each thread process different filtered partition buffer
-* gets the superkmer and count each kmer in it and insert it into hashtable or increase its counter
-* after that thread will update its own sorted map by checking all elements in hashtable
-* */
-
-void TopKmerCounting::HashTableProcess(int partNo, int threadNo) {
-
-    if (this->currentUsedBufferSize[partNo] == 0)
-    {
-        return;
-    }
-    std::unordered_map<std::string, int> kmerHashTable;
-    kmerHashTable.reserve(this->currentUsedBufferSize[partNo] / this->kmersize);
-    std::unique_ptr<char[]> shrkmerRead(new char[this->kmersize + 1]);
-    char * kmerRead = shrkmerRead.get();
-    char *mySuperkmer, *saveptr;
-
-    mySuperkmer = strtok_r(this->filteredData[partNo], "_", &saveptr);		//strtok_r() is thread safe version of strtok() which is not thread safe
-    while (mySuperkmer != NULL)
-    {
-        for (int j = 0; j<(strlen(mySuperkmer) + 1 - (this->kmersize)) && (this->kmersize) <= strlen(mySuperkmer); j++)
-        {
-            strncpy(kmerRead, mySuperkmer + j, this->kmersize);
-            kmerRead[this->kmersize] = '\0';
-            auto it = kmerHashTable.find(kmerRead);
-            if (it != kmerHashTable.end()) {
-                it->second = it->second + 1;
-            }
-            else {
-                kmerHashTable.insert(std::make_pair(kmerRead, 1));
-            }
-        }
-        mySuperkmer = strtok_r(NULL, "_", &saveptr);							//strtok_r() is thread safe version of strtok() which is not thread safe
-    }
-
-    auto minIt = this->myTopCountTable[threadNo].begin();
-    int myTopCountTableMin = minIt->first;
-
-    for (auto it = kmerHashTable.begin(); it != kmerHashTable.end(); ++it)
-    {
-        if (it->second > myTopCountTableMin)
-        {
-            this->myTopCountTable[threadNo].erase(minIt);
-            this->myTopCountTable[threadNo].insert(std::make_pair(it->second, it->first));
-            minIt = this->myTopCountTable[threadNo].begin();
-            myTopCountTableMin = minIt->first;
-        }
-    }
-    kmerHashTable.clear();
-
-    free(this->filteredData[partNo]);
-}
-
-
-/**
-* Function:	HashTableProcessDiskMethod(char *, int )
-* Same as HashTableProcess function but reads files instead of buffers
-* */
-void TopKmerCounting::HashTableProcessDiskMethod(char *Partitionfilename, int threadNo) {
-    std::ifstream partitionFile;
-    partitionFile.open(Partitionfilename, std::ifstream::in);
-
-    if (!partitionFile.good())
-    {
-        std::cout << "File open error" << std::endl;
-        return;
-    }
-    if (partitionFile.peek() == std::ifstream::traits_type::eof())
-    {
-        return;
-    }
-    std::unordered_map<std::string, int> kmerHashTable;
-    std::unique_ptr<char[]> shrmySuperkmer(new char[this->maxLineLenInFile]);
-    char * mySuperkmer = shrmySuperkmer.get();
-    std::unique_ptr<char[]> shrkmerRead(new char[this->kmersize + 1]);
-    char * kmerRead = shrkmerRead.get();
-
-    partitionFile.getline(mySuperkmer, this->maxLineLenInFile, '\n');
-
-    do {
-        for (int j = 0; j<(strlen(mySuperkmer) - this->kmersize + 1); j++)
-        {
-            strncpy(kmerRead, mySuperkmer + j, this->kmersize);
-            kmerRead[this->kmersize] = '\0';
-
-            auto it = kmerHashTable.find(kmerRead);
-            if (it != kmerHashTable.end())
-            {
-                it->second = it->second + 1;
-            }
-            else {
-                kmerHashTable.insert(std::make_pair(kmerRead, 1));
-            }
-        }
-        partitionFile.getline(mySuperkmer, this->maxLineLenInFile, '\n');
-    } while (partitionFile.good());
-
-    auto minIt = this->myTopCountTable[threadNo].begin();
-    int myTopCountTableMin = minIt->first;
-
-    for (auto it = kmerHashTable.begin(); it != kmerHashTable.end(); ++it)
-    {
-        if (it->second > myTopCountTableMin)
-        {
-            this->myTopCountTable[threadNo].erase(minIt);
-            this->myTopCountTable[threadNo].insert(std::make_pair(it->second, it->first));
-            minIt = this->myTopCountTable[threadNo].begin();
-            myTopCountTableMin = minIt->first;
-        }
-    }
-    kmerHashTable.clear();
-    partitionFile.close();
-}
-
-
-
-/**
-* Function:	partition2Table(int )
-* Each thread will run this function and gets the partition buffer which is not processed
-* */
-
-void TopKmerCounting::partition2Table(int threadNo) {
-
-    for (int partNo = 0; partNo<this->maxPartitionNumber; partNo++)
-    {
-        this->partitionMutex.lock();
-        if (this->threadFlag[partNo] == 0)
-        {
-            this->threadFlag[partNo] = 1;
-            this->partitionMutex.unlock();
-        }
-        else {
-            this->partitionMutex.unlock();
-            continue;
-        }
-        HashTableProcess(partNo, threadNo);
-    }
-}
-
-
-/**
-* Function:	partition2TableDiskMethod(TopKmerCounting *,int )
-* Each thread will run this function and gets the partition file which is not processed
-* */
-void TopKmerCounting::partition2TableDiskMethod(int threadNo) {
-
-    char buffer[100];
-    std::string tempDir;
-    tempDir.append("./temp");
-    std::string binFileName("/kmer");
-
-    for (int f = 0; f<this->maxPartitionNumber; f++)
-    {
-        this->partitionMutex.lock();
-        if (this->threadFlag[f] == 0)
-        {
-            this->threadFlag[f] = 1;
-            this->partitionMutex.unlock();
-        }
-        else {
-            this->partitionMutex.unlock();
-            continue;
-        }
-        sprintf(buffer, "%s%s%d.txt", tempDir.c_str(), binFileName.c_str(), f);
-        HashTableProcessDiskMethod(buffer, threadNo);
-        remove(buffer);
-    }
-}
-
-
-/**
-* Function:	HistogramProcess()
-* This function calculates histograms in two different ways
-* 1st: sum of 1/numberofkmers, numberofkmers: which shares the same minimizer in superkmer
-* 2nd: sum of numberofkmers,	numberofkmers: which shares the same minimizer in superkmer
-*
-* some minimizers are unique to one kmer
-* and some minimizers are shared by so many kmers
-*
-* therefore both histogram are usefull to identify top kmers
-* */
-
-void TopKmerCounting::HistogramProcess() {
-
-    std::ifstream MyFile;
-    MyFile.open(this->fastqFilename, std::ifstream::in);
-
-    if (!MyFile)
-    {
-        std::cerr << "Error opening " << this->fastqFilename << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    std::unique_ptr<char[]> shrmyline(new char[this->maxLineLenInFile]);
-    char * myline = shrmyline.get();
-    std::unique_ptr<uint64_t[]> shrmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]);
-    uint64_t *myIntLine = shrmyIntLine.get();
-    MyFile.ignore(MAXLINELENGTH, '\n');
-    MyFile.getline(myline, this->maxLineLenInFile);
-
-    int line_len;
-    int min_pos;
-    uint64_t MinimizerValue, nextCandMin;
-    int numberOfKmers;
-    do {
-        line_len = (int)strlen(myline);
-        if (strspn(myline, "ACGT") != line_len)
-        {
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.getline(myline, this->maxLineLenInFile);
-            continue;
-        }
-        convertStringToInt64(myline, myIntLine);
-        min_pos = findMinimumPSubstring(myIntLine, 0, this->kmersize, MinimizerValue);
-        numberOfKmers = 1;
-        for (int i = 1; i<line_len - this->kmersize + 1; i++)
-        {
-            if (i>min_pos)
-            {
-                this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
-                this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
-                this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
-                min_pos = findMinimumPSubstring(myIntLine, i, i + this->kmersize, MinimizerValue);
-                numberOfKmers = 1;
-            }
-            else if (CompareLastPSubstringWithMin(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
-            {
-                this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
-                this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
-                this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
-                min_pos = i + this->kmersize - this->mmrLen;
-                MinimizerValue = nextCandMin;
-                numberOfKmers = 1;
-            }
-            else {
-                numberOfKmers++;
-            }
-        }
-        this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
-        this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
-        this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
-        for (int j = 0; j<this->histogramReadRate && MyFile.good(); j++)
-        {
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.ignore(MAXLINELENGTH, '\n');
-            MyFile.getline(myline, this->maxLineLenInFile);
-        }
-    } while (MyFile.good());
-    MyFile.close();
-}
-
-uint64_t getSizeofFile(const char *filename) {
-    std::ifstream MyFile;
-    MyFile.open(filename, std::ifstream::in);
-    if (!MyFile)
-    {
-        std::cerr << "Error opening " << filename << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    MyFile.seekg(0, MyFile.end);
-    uint64_t length = MyFile.tellg();
-    MyFile.close();
-    return length;
-}
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+/* We are on Windows */
+#include <direct.h>
+#include <windows.h>
+#include <stdio.h>
+#include <tchar.h>
+#include <process.h>
+
+#else
+
+/* We are on Non-Windows */
+#include <unistd.h>
+#define _getpid getpid
+#define _rmdir rmdir
+#define _mkdir(name) mkdir(name,S_IRWXU)
+#endif
+
+#include "mylib.h"
+
+const int BUFFERINCREMENTSIZE = 2000000;
+const int MAXLINELENGTH = 256;
+const int MAXPARTITION = 256;
+const int SPILLIOTHREADS = 4;
+const uint32_t RECYCLEDBUFFERSIZE = BUFFERINCREMENTSIZE;    // bigger partition buffers are not kept for next job
+const size_t RECYCLEDTABLESIZE = 1 << 16;                   // bigger hash tables and sort arrays are not kept for next partition
+const uint64_t MINFILESIZEFORFILTER = 500000000;	// ~500mb
+const uint64_t BIGFILESIZE = 10000000000;
+
+/**
+* Function:	minimizerLength(int )
+* Default minimizer length is MAXMINIMIZERLEN, shorter only if kmersize is less than that.
+* Kmersize is checked before histograms are allocated so out of range values give a small length.
+* */
+
+static int minimizerLength(int givenKmerSize) {
+    if (givenKmerSize>90 || givenKmerSize<3)
+    {
+        return 1;
+    }
+    if (givenKmerSize<=MAXMINIMIZERLEN) // In case kmersize is less than defaul mmrLen
+    {
+        return givenKmerSize - 1;
+    }
+    return MAXMINIMIZERLEN;
+}
+
+
+TopKmerCounting::TopKmerCounting(const CountingConfig &config, ThreadPool &givenThreadPool, CountingWorkspace *givenWorkspace)
+    :kmersize(config.kmerSize), topcount(config.topCount), // initializer list for const variable members
+    mmrLen(minimizerLength(config.kmerSize)),
+    maxLineLenInFile(MAXLINELENGTH), maxPartitionNumber(MAXPARTITION),
+    ownedWorkspace(givenWorkspace ? NULL : new CountingWorkspace()),
+    workspace(givenWorkspace ? *givenWorkspace : *ownedWorkspace),
+    threadPool(givenThreadPool)
+{
+    if (kmersize>90 || kmersize<3)
+    {
+        throw std::invalid_argument("kmersize value is only allowed in range 3-90");
+    }
+    if (topcount<1)
+    {
+        throw std::invalid_argument("topcount value must be bigger than 0");
+    }
+    if (config.shardCount<1 || config.shardCount>maxPartitionNumber || config.shardIndex<0 || config.shardIndex >= config.shardCount)
+    {
+        throw std::invalid_argument("shard must be i/n with 0 <= i < n <= " + std::to_string(maxPartitionNumber));
+    }
+    shardIndex = config.shardIndex;
+    shardCount = config.shardCount;
+
+    fastqFilename = config.fastqFilename;
+
+    int kmerWords = (kmersize * 2 + 63) / 64;
+    kmerTopWordMask = andTable[(kmersize * 2) - ((kmerWords - 1) * 64)];
+    countingEngine = config.engine;
+    kernels = selectKernels(kmerWords, mmrLen, countingEngine);		// all hot loops are specialized, no need to check lengths again
+
+    // 	the parameters below are not really good, with enough time one can get proper
+    //	formula for bigfiles when high topcount is asked
+    if (getSizeofFile(fastqFilename.c_str()) < MINFILESIZEFORFILTER)
+    {
+        maxDepthSearch = (1 << (mmrLen * 2)) - 1;			// To be sure toplist is correct
+        isBigFileEnabled = 0;
+        histogramReadRate = 10;
+    }
+    else {
+        if (topcount<25)
+        {
+            maxDepthSearch = 50;
+        }
+        else {
+            maxDepthSearch = topcount * 2;
+        }
+        isBigFileEnabled = 1;
+        histogramReadRate = 10;
+    }
+
+    if (topcount>1000 && isBigFileEnabled)
+    {
+        isDiskMethodEnabled = 1;
+        maxDepthSearch = topcount * 2;
+        histogramReadRate = 10;
+    }
+    else {
+        isDiskMethodEnabled = 0;
+    }
+
+    if (topcount>1000 && getSizeofFile(fastqFilename.c_str())>BIGFILESIZE)
+    {
+        isDiskMethodEnabled = 1;
+        maxDepthSearch = topcount * 4;
+        histogramReadRate = 5;
+    }
+    else if (getSizeofFile(fastqFilename.c_str())>BIGFILESIZE)
+    {
+        isDiskMethodEnabled = 0;
+        maxDepthSearch = topcount * 4;
+        histogramReadRate = 5;
+    }
+    // 	the parameters above are not really good, with enough time one can get proper
+    //	formula for bigfiles when high topcount is asked. might calculating deviation help?
+
+    if (maxDepthSearch>(1 << (mmrLen * 2)))
+    {
+        maxDepthSearch = (1 << (mmrLen * 2)) - 1;        //In case maxDepthSearch is bigger than border
+    }
+
+    nThreads = threadPool.Size();
+    numaPlacement = config.numaPlacement;
+    isDirectIOEnabled = config.directIO ? 1 : 0;
+    tempRootDirs = config.tempDirs;
+    if (tempRootDirs.empty())
+    {
+        tempRootDirs.push_back(".");
+    }
+    threadFlag = new int[maxPartitionNumber];
+    for (int i = 0; i<maxPartitionNumber; i++)
+    {
+        threadFlag[i] = 0;					//Initially all partitions are not processed so they are initialized 0
+    }
+
+    myTopCountTable = new std::multimap<int, std::string>[nThreads];			//all threads need its own sorted list before merging
+
+    workspace.prepare((1 << (mmrLen * 2)) + 1, nThreads, numaPlacement == NUMA_EXPLICIT);
+    minimizerHistogramDiv = workspace.minimizerHistogramDiv.get(); sortedMinimizersDiv = workspace.sortedMinimizersDiv.get();
+    minimizerHistogramFac = workspace.minimizerHistogramFac.get(); sortedMinimizersFac = workspace.sortedMinimizersFac.get();
+    minimizerHistogramSum = workspace.minimizerHistogramSum.get(); sortedMinimizersSum = workspace.sortedMinimizersSum.get();
+
+                                                                                //(1<<(mmrLen*2)) is the number of all different minimizers
+
+    for (int i = 0; i <= (1 << (mmrLen * 2)); i++)
+    {
+        minimizerHistogramDiv[i] = 0.0;	minimizerHistogramFac[i] = 0; minimizerHistogramSum[i] = 0;
+    }
+
+    //partition buffers are allocated by growPartitionBuffer when first superkmer comes, or recycled from previous job
+    filteredData = workspace.filteredData;
+    currentBufferSize = workspace.currentBufferSize;
+    currentUsedBufferSize = workspace.currentUsedBufferSize;
+}
+
+TopKmerCounting::~TopKmerCounting() {
+    myTopCountTable[0].clear();				//	others already cleared when combining
+
+    for (int i = 0; i<maxPartitionNumber; i++)
+    {
+        releasePartitionBuffer(i);			//	most already released during counting
+    }
+    if (!tempDirs.empty())
+    {
+        for (int f = 0; f<maxPartitionNumber; f++)
+        {
+            remove(partitionFileName(f).c_str());	//	only left if counting was interrupted
+        }
+        removeTempDirs();
+    }
+    delete[] myTopCountTable;
+    delete[] threadFlag;
+}
+
+/**
+* Function:	resetKmerTables(KmerTables<W> &, int )
+* One table and array per thread, emptied in case previous job was interrupted
+* */
+
+template<int W>
+static void resetKmerTables(KmerTables<W> &tables, int threadCount) {
+    if ((int)tables.hashTables.size() < threadCount)
+    {
+        tables.hashTables.resize(threadCount);
+        tables.sortArrays.resize(threadCount);
+    }
+    for (size_t t = 0; t < tables.hashTables.size(); t++)
+    {
+        tables.hashTables[t].clear();
+        tables.sortArrays[t].clear();
+    }
+}
+
+CountingWorkspace::CountingWorkspace()
+    :histogramSize(0), partitionCount(MAXPARTITION), nodeBoundBuffers(false)
+{
+    filteredData = (char**)malloc(partitionCount * sizeof(char*));
+    currentBufferSize = new uint32_t[partitionCount];
+    currentUsedBufferSize = new uint32_t[partitionCount];
+    for (int i = 0; i<partitionCount; i++)
+    {
+        filteredData[i] = NULL;
+        currentBufferSize[i] = 0;
+        currentUsedBufferSize[i] = 0;
+    }
+}
+
+CountingWorkspace::~CountingWorkspace() {
+    freeBuffers();
+    delete[] currentBufferSize;
+    delete[] currentUsedBufferSize;
+    free(filteredData);
+}
+
+/**
+* Function:	prepare(int , int , bool )
+* Makes the workspace ready for a new job. Histograms are only reallocated if they are too small,
+* recycled buffers are kept unless they come from a different allocator
+* */
+
+void CountingWorkspace::prepare(int givenHistogramSize, int threadCount, bool nodeBound) {
+    if (histogramSize < givenHistogramSize)
+    {
+        minimizerHistogramDiv.reset(new float[givenHistogramSize]); sortedMinimizersDiv.reset(new float[givenHistogramSize]);
+        minimizerHistogramFac.reset(new uint32_t[givenHistogramSize]); sortedMinimizersFac.reset(new uint32_t[givenHistogramSize]);
+        minimizerHistogramSum.reset(new uint32_t[givenHistogramSize]); sortedMinimizersSum.reset(new uint32_t[givenHistogramSize]);
+        histogramSize = givenHistogramSize;
+    }
+    if (nodeBound != nodeBoundBuffers)
+    {
+        freeBuffers();
+        nodeBoundBuffers = nodeBound;
+    }
+    for (int i = 0; i<partitionCount; i++)
+    {
+        currentUsedBufferSize[i] = 0;
+    }
+    resetKmerTables(std::get<0>(kmerTables), threadCount);
+    resetKmerTables(std::get<1>(kmerTables), threadCount);
+    resetKmerTables(std::get<2>(kmerTables), threadCount);
+}
+
+void CountingWorkspace::freeBuffers() {
+    for (int i = 0; i<partitionCount; i++)
+    {
+        if (nodeBoundBuffers)
+        {
+            FreeOnNode(filteredData[i], currentBufferSize[i]);
+        }
+        else {
+            free(filteredData[i]);
+        }
+        filteredData[i] = NULL;
+        currentBufferSize[i] = 0;
+    }
+}
+
+void TopKmerCounting::StartCounting() {
+    if (isDiskMethodEnabled)
+    {
+        RunProcessInDISK();
+    }
+    else {
+        RunProcessInRAM();
+    }
+}
+
+void TopKmerCounting::RunProcessInRAM() {
+
+    (this->*kernels.histogramProcess)();					//Histogram function for minimizers
+
+    //std::cout << "hist done" << std::endl;
+    std::copy_n(minimizerHistogramDiv, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersDiv);
+    std::copy_n(minimizerHistogramFac, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersFac);
+    std::copy_n(minimizerHistogramSum, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersSum);
+
+    //We need sorted histogram for later filtering
+    std::sort(sortedMinimizersDiv, sortedMinimizersDiv + (uint32_t)(1 << (mmrLen * 2)), [](const float x, const float y)->bool {return x > y;});
+    std::sort(sortedMinimizersFac, sortedMinimizersFac + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
+    std::sort(sortedMinimizersSum, sortedMinimizersSum + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
+
+    //All threads will have initialized toplist map with dummy values
+    for (int t = 0; t < nThreads; t++) {
+        for (int i = 0; i < topcount; i++)	myTopCountTable[t].insert(std::make_pair(0 - i, "dummyString"));
+    }
+
+    //std::cout << "partitionProcess" << std::endl;
+
+    (this->*kernels.partitionProcess)();		// by using histograms, file is written into partitions buffer and also filtered
+
+    //all threads will process different filtered partition data and keep always toplist by inserting into their own hashtable
+    threadPool.Run(nThreads, [this](int t) { this->partition2Table(t); });
+
+    // after all threads done, merging toplist maps into myTopCountTable[0]
+    for (int i = 1; i<nThreads; i++)
+    {
+        auto minIt = myTopCountTable[0].begin();
+        int myTopCountTableMin = minIt->first;
+
+        for (auto it = myTopCountTable[i].begin(); it != myTopCountTable[i].end(); ++it)
+        {
+            if (it->first > myTopCountTableMin)
+            {
+                myTopCountTable[0].erase(minIt);
+                myTopCountTable[0].insert(std::make_pair(it->first, it->second));
+                minIt = myTopCountTable[0].begin();
+                myTopCountTableMin = minIt->first;
+            }
+        }
+        myTopCountTable[i].clear();
+    }
+}
+
+void TopKmerCounting::RunProcessInDISK() {
+
+    (this->*kernels.histogramProcess)();					//Histogram function for minimizers
+    //Threads writing and prefetching partition files, more disks can take more parallel requests
+    ioPool.reset(new ThreadPool(std::max(SPILLIOTHREADS, 2 * (int)tempRootDirs.size()), false));
+
+    //std::cout << "hist done" << std::endl;
+
+    std::copy_n(minimizerHistogramDiv, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersDiv);
+    std::copy_n(minimizerHistogramFac, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersFac);
+    std::copy_n(minimizerHistogramSum, (uint32_t)(1 << (mmrLen * 2)), sortedMinimizersSum);
+
+    //We need sorted histogram for later filtering
+    std::sort(sortedMinimizersDiv, sortedMinimizersDiv + (uint32_t)(1 << (mmrLen * 2)), [](const float x, const float y)->bool {return x > y;});
+    std::sort(sortedMinimizersFac, sortedMinimizersFac + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
+    std::sort(sortedMinimizersSum, sortedMinimizersSum + (uint32_t)(1 << (mmrLen * 2)), [](const uint32_t x, const uint32_t y)->bool {return x > y;});
+
+    //All threads will have initialized toplist map with dummy values
+    for (int t = 0; t<nThreads; t++)
+    {
+        for (int i = 0; i < topcount; i++)
+        {
+            myTopCountTable[t].insert(std::make_pair(0 - i, "dummyString"));
+        }
+    }
+
+    //std::cout << "partitionProcess" << std::endl;
+
+    (this->*kernels.partitionProcessDiskMethod)();		// by using histograms, file is written into partitions buffer and also filtered
+
+    //all threads will process different filtered partition data and keep always toplist by inserting into their own hashtable
+    threadPool.Run(nThreads, [this](int t) { this->partition2TableDiskMethod(t); });
+
+    ioPool.reset();
+    removeTempDirs();
+
+    // after all threads done, merging toplist maps into myTopCountTable[0]
+    for (int i = 1; i<nThreads; i++)
+    {
+        auto minIt = myTopCountTable[0].begin();
+        int myTopCountTableMin = minIt->first;
+
+        for (auto it = myTopCountTable[i].begin(); it != myTopCountTable[i].end(); ++it)
+        {
+            if (it->first > myTopCountTableMin)
+            {
+                myTopCountTable[0].erase(minIt);
+                myTopCountTable[0].insert(std::make_pair(it->first, it->second));
+                minIt = myTopCountTable[0].begin();
+                myTopCountTableMin = minIt->first;
+            }
+        }
+        myTopCountTable[i].clear();
+    }
+}
+
+/**
+* Function:	GetTopList()
+* Returns the merged toplist, most frequent kmer first.
+* Dummy entries are left out when there are less than topcount different kmers
+* */
+
+TopKmerList TopKmerCounting::GetTopList() const {
+    TopKmerList topList;
+    for (auto it = myTopCountTable[0].end(); it != myTopCountTable[0].begin(); )
+    {
+        it--;
+        if (it->first <= 0)
+        {
+            break;
+        }
+        KmerCount entry;
+        entry.kmer = it->second;
+        entry.count = it->first;
+        topList.push_back(entry);
+    }
+    return topList;
+}
+
+void TopKmerCounting::DisplayTopList(std::ostream &out) const {
+    TopKmerList topList = GetTopList();
+    for (size_t i = 0; i < topList.size(); i++)
+    {
+        out << topList[i].kmer << " " << topList[i].count << std::endl;
+    }
+}
+
+/**
+* Function:	selectKernels(int , int , CountingEngine )
+* Dispatch table of the counting pipeline. Scanning kernels are specialized on minimizer length
+* and counting kernels on the number of 64bit words a packed kmer needs, so inner loops use
+* fixed shifts and masks. It is called once by the constructor.
+* */
+
+TopKmerCounting::CountingKernels TopKmerCounting::selectKernels(int kmerWords, int minimizerLen, CountingEngine engine) {
+    typedef void (TopKmerCounting::*ScanKernel)();
+    typedef void (TopKmerCounting::*HashKernel)(int p, int t);
+    typedef void (TopKmerCounting::*HashDiskKernel)(const char *partitionData, size_t dataLen, int t);
+
+    static const ScanKernel histogramKernels[MAXMINIMIZERLEN + 1] = { nullptr,
+        &TopKmerCounting::HistogramProcess<1>, &TopKmerCounting::HistogramProcess<2>, &TopKmerCounting::HistogramProcess<3>,
+        &TopKmerCounting::HistogramProcess<4>, &TopKmerCounting::HistogramProcess<5>, &TopKmerCounting::HistogramProcess<6>,
+        &TopKmerCounting::HistogramProcess<7>, &TopKmerCounting::HistogramProcess<8>, &TopKmerCounting::HistogramProcess<9>,
+        &TopKmerCounting::HistogramProcess<10> };
+    static const ScanKernel partitionKernels[MAXMINIMIZERLEN + 1] = { nullptr,
+        &TopKmerCounting::partitionProcess<1>, &TopKmerCounting::partitionProcess<2>, &TopKmerCounting::partitionProcess<3>,
+        &TopKmerCounting::partitionProcess<4>, &TopKmerCounting::partitionProcess<5>, &TopKmerCounting::partitionProcess<6>,
+        &TopKmerCounting::partitionProcess<7>, &TopKmerCounting::partitionProcess<8>, &TopKmerCounting::partitionProcess<9>,
+        &TopKmerCounting::partitionProcess<10> };
+    static const ScanKernel partitionDiskKernels[MAXMINIMIZERLEN + 1] = { nullptr,
+        &TopKmerCounting::partitionProcessDiskMethod<1>, &TopKmerCounting::partitionProcessDiskMethod<2>,
+        &TopKmerCounting::partitionProcessDiskMethod<3>, &TopKmerCounting::partitionProcessDiskMethod<4>,
+        &TopKmerCounting::partitionProcessDiskMethod<5>, &TopKmerCounting::partitionProcessDiskMethod<6>,
+        &TopKmerCounting::partitionProcessDiskMethod<7>, &TopKmerCounting::partitionProcessDiskMethod<8>,
+        &TopKmerCounting::partitionProcessDiskMethod<9>, &TopKmerCounting::partitionProcessDiskMethod<10> };
+    static const HashKernel hashKernels[MAXKMERWORDS + 1] = { nullptr,
+        &TopKmerCounting::HashTableProcess<1>, &TopKmerCounting::HashTableProcess<2>, &TopKmerCounting::HashTableProcess<3> };
+    static const HashDiskKernel hashDiskKernels[MAXKMERWORDS + 1] = { nullptr,
+        &TopKmerCounting::HashTableProcessDiskMethod<1>, &TopKmerCounting::HashTableProcessDiskMethod<2>,
+        &TopKmerCounting::HashTableProcessDiskMethod<3> };
+    static const HashKernel sortKernels[MAXKMERWORDS + 1] = { nullptr,
+        &TopKmerCounting::SortCountProcess<1>, &TopKmerCounting::SortCountProcess<2>, &TopKmerCounting::SortCountProcess<3> };
+    static const HashDiskKernel sortDiskKernels[MAXKMERWORDS + 1] = { nullptr,
+        &TopKmerCounting::SortCountProcessDiskMethod<1>, &TopKmerCounting::SortCountProcessDiskMethod<2>,
+        &TopKmerCounting::SortCountProcessDiskMethod<3> };
+
+    CountingKernels selected;
+    selected.histogramProcess = histogramKernels[minimizerLen];
+    selected.partitionProcess = partitionKernels[minimizerLen];
+    selected.partitionProcessDiskMethod = partitionDiskKernels[minimizerLen];
+    if (engine == ENGINE_SORT)
+    {
+        selected.hashTableProcess = sortKernels[kmerWords];
+        selected.hashTableProcessDiskMethod = sortDiskKernels[kmerWords];
+    }
+    else {
+        selected.hashTableProcess = hashKernels[kmerWords];
+        selected.hashTableProcessDiskMethod = hashDiskKernels[kmerWords];
+    }
+    return selected;
+}
+
+
+/**
+* Function:  getMinimizerValue(const char *GSeq, int MinSubPos)
+* It calculates the integer value of a minimizer 				**
+* for given char array and position of minimizer				**
+* 																**
+* 	**************************************************************
+* */
+
+/*
+int getMinimizerValue(const char *GSeq, int MinSubPos){
+int ret_value = 0;
+for(int i=0 ; i<G_MMRLen ; i++){
+ret_value *=4;
+if(GSeq[MinSubPos+i] == 'C')
+ret_value += 1;
+else if(GSeq[MinSubPos+i] == 'G')
+ret_value += 2;
+else if(GSeq[MinSubPos+i] == 'T')
+ret_value += 3;
+}
+return ret_value;
+}
+*/
+
+/**
+int CheckBadMinSubstring(const char *GSeq, int i){
+if(!strncmp(GSeq+i,"AAA",3) || !strncmp(GSeq+i,"ACA",3))
+return 1;
+for(int j=1 ; j<G_MMRLen-1 ; j++)
+if(!strncmp(GSeq+i+j,"AA",2))
+return 1;
+return 0;
+}
+**/
+
+/**
+* Function:	CheckBadMinSubstring(uint64_t )
+* 		Int64 version of CheckBadMinSubstring(const char *GSeq, int i).
+* 		This function checks if given IntString has AAA and ACA prefixes
+*  	and also AA anywhere except beginning of the string
+*
+* */
+
+template<int MMR>
+static int CheckBadMinSubstring(uint64_t nextCand) {
+    const int prefixShift = (MMR >= 3) ? ((MMR - 3) * 2) : 0;
+    if (MMR >= 3 && ((nextCand >> prefixShift) == 0 || (nextCand >> prefixShift) == 0x04))
+    {        //Checking AAA and ACA prefix
+        return 1;
+    }
+    for (int i = 2; i<MMR; i++) {													//Checking AA if it anywhere except beginning
+        if ((nextCand & 0xf) == 0)
+        {
+            return 1;
+        }
+        nextCand >>= 2;
+    }
+    return 0;
+}
+
+
+/**
+* Function:	getPSubstring(const uint64_t *, int )
+* Returns the MMR length substring starting at pos as an integer.
+* Both int64 words are always read, (x >> 1) >> (63 - n) equals x >> (64 - n) even when n is 0,
+* so a minimizer lying in two int64 does not need a branch. Array must have one spare int64 at the end.
+* */
+
+template<int MMR>
+static inline uint64_t getPSubstring(const uint64_t *GSeq, int pos) {
+    const int leftSideBitLen = ((pos & 0x1f) * 2);
+    const int intIndex = pos >> 5;
+    uint64_t window = (GSeq[intIndex] << leftSideBitLen) | ((GSeq[intIndex + 1] >> 1) >> (63 - leftSideBitLen));
+    return window >> (64 - (MMR * 2));
+}
+
+
+/**
+* 	Function:  CompareLastPSubstringWithMin(const uint64_t *, int, int ,uint64_t &, uint64_t &)
+*
+* 	This function check if the last MMR length substring
+* 	is a new minimizer after shifting string one letter
+*
+* */
+
+template<int MMR>
+static int CompareLastPSubstringWithMin(const uint64_t *GSeq, int endPos, int MinSubPos, uint64_t &minCand, uint64_t &nextCand) {
+    nextCand = getPSubstring<MMR>(GSeq, endPos - MMR);
+    if (minCand > nextCand)
+    {
+        if (CheckBadMinSubstring<MMR>(nextCand))
+        {
+            return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+int findMinimumPSubstring(const char *GSeq, int startPos, int endPos){
+int MinSubPos = startPos;
+for(int i=startPos+1 ; i<=endPos-G_MMRLen ; i++){
+for(int j=0 ; j<G_MMRLen ; j++){
+if(GSeq[MinSubPos+j] < GSeq[i+j])
+break;
+else
+if(GSeq[MinSubPos+j] > GSeq[i+j]){
+if(CheckBadMinSubstring(GSeq, i))
+break;
+MinSubPos=i;
+break;
+}
+}
+}
+return MinSubPos;
+}
+**/
+
+/**
+* Function:  findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue)
+* This function is the 64bit integer version of findMinimumPSubstring above.
+* for given int64 array, by shifting 2 bits i.e. one letter, all substrings are checked one by one
+* faster than char version
+* getPSubstring does the shifting when a minimizer is in two int64
+* */
+
+template<int MMR>
+static int findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue) {
+    int MinSubPos = startPos;
+    uint64_t minCand = getPSubstring<MMR>(GSeq, startPos);
+    uint64_t nextCand;
+
+    for (int i = startPos + 1; i <= endPos - MMR; i++) {
+        nextCand = getPSubstring<MMR>(GSeq, i);
+        if (minCand > nextCand)
+        {
+            if (CheckBadMinSubstring<MMR>(nextCand))
+            {
+                continue;
+            }
+            MinSubPos = i;
+            minCand = nextCand;
+        }
+    }
+    MinimizerValue = minCand;
+    return MinSubPos;
+}
+
+
+/**
+* Function:	convertStringToInt64(const char *, uint64_t *)
+* This function converts given string into int64 arrays and fills the empty array
+* A=00	C=01	G=10	T=11
+* */
+
+static void convertStringToInt64(const char *GSeq, uint64_t *GSeqInt) {
+    int char_len = (int)strlen(GSeq);
+    int intArrayEnd = ((char_len + 31) >> 5);
+    for (int i = 0; i<intArrayEnd; i++) GSeqInt[i] = 0;
+    for (int i = 0; i<char_len; i++)
+    {
+        GSeqInt[i >> 5] = (GSeqInt[i >> 5] << 2) + char2IntTable[GSeq[i] - 'A'];
+    }
+
+    for (int i = 0; i<(32 - (char_len & 0x1f)); i++)
+    {
+        GSeqInt[char_len >> 5] = (GSeqInt[char_len >> 5] << 2);
+    }
+}
+
+/**
+* Function:	convertInt64ToString(const uint64_t *, char *, int )
+* This functions converts given int64 array into char string
+* 00=A	01=C	10=G	11=T
+* */
+
+void convertInt64ToString(const uint64_t *GSeqInt, char *GSeq, int char_len) {
+    for (int i = 0; i<char_len; i++)
+    {
+        GSeq[i] = Int2charTable[((GSeqInt[i >> 5] >> (62 - ((i & 0x1f) << 1))) & 0x3)] + 'A';
+    }
+    GSeq[char_len] = '\0';
+}
+
+/**
+* Function:	convertPackedKmerToString(const PackedKmer<W> &, int , char *)
+* Same as convertInt64ToString but for kmers packed from right by countSuperkmer
+* */
+
+template<int W>
+static void convertPackedKmerToString(const PackedKmer<W> &kmer, int char_len, char *GSeq) {
+    for (int i = 0; i<char_len; i++)
+    {
+        int bitPos = (char_len - 1 - i) * 2;
+        GSeq[i] = Int2charTable[(kmer.word[W - 1 - (bitPos >> 6)] >> (bitPos & 0x3f)) & 0x3] + 'A';
+    }
+    GSeq[char_len] = '\0';
+}
+
+/**
+* Function:	copySkmerToBuffer(char *, int , int , uint64_t &)
+* This function copy superkmer into buffer in a custom way
+* adding delimiter char '_' between superkmers and at the end there is null character
+* eg.
+* AAAAACTGCTCGTATTATTCG_ACATCATCTATCACTATCTATCTATC\0
+* when a new superkmer added, this is what happens
+* AAAAACTGCTCGTATTATTCG_ACATCATCTATCACTATCTATCTATC_TATCTATCTACTTATCT\0
+* */
+
+void TopKmerCounting::copySkmerToBuffer(char *myline, int startpos, int endpos, uint64_t &MinimizerValue) {
+    uint32_t partNumber = ((uint32_t)MinimizerValue) % this->maxPartitionNumber;
+    if (!ownsPartition(partNumber))
+    {
+        return;					// counted by another shard
+    }
+    if (this->currentBufferSize[partNumber] > this->currentUsedBufferSize[partNumber] + endpos - startpos + 4)
+    {
+        strncpy(this->filteredData[partNumber] + this->currentUsedBufferSize[partNumber], myline + startpos, endpos - startpos + 1);
+        this->filteredData[partNumber][this->currentUsedBufferSize[partNumber] + endpos - startpos + 1] = '_';
+        this->currentUsedBufferSize[partNumber] = this->currentUsedBufferSize[partNumber] + endpos - startpos + 2;
+    }
+    else {
+        growPartitionBuffer(partNumber);
+        strncpy(this->filteredData[partNumber] + this->currentUsedBufferSize[partNumber], myline + startpos, endpos - startpos + 1);
+        this->filteredData[partNumber][this->currentUsedBufferSize[partNumber] + endpos - startpos + 1] = '_';
+        this->currentUsedBufferSize[partNumber] = this->currentUsedBufferSize[partNumber] + endpos - startpos + 2;
+    }
+    this->filteredData[partNumber][this->currentUsedBufferSize[partNumber]] = '\0';
+}
+
+/**
+* Function:	spillSkmer(SpillWriter &, const char *, int , uint64_t )
+* Disk method version of copySkmerToBuffer, superkmer goes to the file of its partition
+* */
+
+void TopKmerCounting::spillSkmer(SpillWriter &spillWriter, const char *skmer, int skmerLen, uint64_t MinimizerValue) {
+    uint32_t partNumber = ((uint32_t)MinimizerValue) % this->maxPartitionNumber;
+    if (ownsPartition(partNumber))
+    {
+        spillWriter.AppendLine(partNumber, skmer, skmerLen);
+    }
+}
+
+/**
+* Function:	partitionNode(int )
+* NUMA node whose threads should count given partition, partitions are spread over nodes
+* */
+
+int TopKmerCounting::partitionNode(int partNo) {
+    return threadPool.NodeId(partNo % threadPool.NodeCount());
+}
+
+/**
+* Function:	growPartitionBuffer(int )
+* Enlarges a partition buffer by BUFFERINCREMENTSIZE. With explicit NUMA placement
+* buffer pages are bound to the node of the partition, otherwise it is a plain realloc
+* */
+
+void TopKmerCounting::growPartitionBuffer(int partNo) {
+    size_t newSize = (size_t)this->currentBufferSize[partNo] + BUFFERINCREMENTSIZE;
+    char *grown;
+    if (this->numaPlacement == NUMA_EXPLICIT)
+    {
+        grown = (char*)ReallocateOnNode(this->filteredData[partNo], this->currentBufferSize[partNo], newSize, partitionNode(partNo));
+    }
+    else {
+        grown = (char*)realloc(this->filteredData[partNo], newSize * sizeof(char));
+    }
+    if (grown == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    this->filteredData[partNo] = grown;
+    this->currentBufferSize[partNo] = (uint32_t)newSize;
+}
+
+/**
+* Function:	releasePartitionBuffer(int )
+* Called when a partition is counted. Small buffers stay in the workspace for the next job,
+* big ones are freed since counting needs the memory
+* */
+
+void TopKmerCounting::releasePartitionBuffer(int partNo) {
+    if (this->currentBufferSize[partNo] <= RECYCLEDBUFFERSIZE)
+    {
+        return;
+    }
+    freePartitionBuffer(partNo);
+}
+
+void TopKmerCounting::freePartitionBuffer(int partNo) {
+    if (this->numaPlacement == NUMA_EXPLICIT)
+    {
+        FreeOnNode(this->filteredData[partNo], this->currentBufferSize[partNo]);
+    }
+    else {
+        free(this->filteredData[partNo]);
+    }
+    this->filteredData[partNo] = NULL;
+    this->currentBufferSize[partNo] = 0;
+}
+
+/**
+* Function:	localizePartitionBuffer(int )
+* With first touch placement, the counting thread copies the partition into memory it touches first,
+* so the buffer is on the node of the thread instead of the node of partitionProcess thread
+* */
+
+void TopKmerCounting::localizePartitionBuffer(int partNo) {
+    if (this->numaPlacement != NUMA_FIRST_TOUCH || this->filteredData[partNo] == NULL)
+    {
+        return;
+    }
+    char *localCopy = (char*)malloc(this->currentUsedBufferSize[partNo] + 1);
+    if (localCopy == NULL)
+    {
+        return;					// keep the remote one
+    }
+    memcpy(localCopy, this->filteredData[partNo], this->currentUsedBufferSize[partNo] + 1);
+    freePartitionBuffer(partNo);
+    this->filteredData[partNo] = localCopy;
+    this->currentBufferSize[partNo] = this->currentUsedBufferSize[partNo] + 1;
+}
+
+/**
+* This function opens the fastqfile and read one line each time, calculate minimizers and check histograms
+* and then if it is in the range, superkmer including that minimizer will be written into buffers
+* */
+
+template<int MMR>
+void TopKmerCounting::partitionProcess() {
+
+    std::ifstream MyFile;
+    MyFile.open(this->fastqFilename, std::ifstream::in);
+
+    if (!MyFile)
+    {
+        throw std::runtime_error("Error opening " + this->fastqFilename);
+    }
+    std::unique_ptr<char[]> shrdmyline(new char[this->maxLineLenInFile]);
+    char * myline = shrdmyline.get();
+    std::unique_ptr<uint64_t[]> shrdmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]());
+    uint64_t *myIntLine = shrdmyIntLine.get();
+
+    MyFile.ignore(MAXLINELENGTH, '\n');
+    MyFile.getline(myline, this->maxLineLenInFile);
+
+    int line_len;
+
+    uint64_t MinimizerValue, nextCandMin;
+
+    do {
+        line_len = (int)strlen(myline);
+        if (strspn(myline, "ACGT") != line_len || line_len < this->kmersize)
+        {
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.getline(myline, this->maxLineLenInFile);
+            continue;
+        }
+        convertStringToInt64(myline, myIntLine);
+        int min_pos = findMinimumPSubstring<MMR>(myIntLine, 0, this->kmersize, MinimizerValue);
+        int next_min_pos;
+        int SKmerPosStart = 0;
+        int SKmerPosEnd = this->kmersize - 1;
+        for (int i = 1; i<line_len - this->kmersize + 1; i++)
+        {
+            if (i>min_pos)
+            {
+                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+                {
+                    next_min_pos = findMinimumPSubstring<MMR>(myIntLine, i, i + this->kmersize, nextCandMin);
+                    if (nextCandMin == MinimizerValue)
+                    {
+                        min_pos = next_min_pos;
+                        SKmerPosEnd++;
+                        continue;
+                    }
+                    copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
+                }
+                SKmerPosStart = i;
+                min_pos = findMinimumPSubstring<MMR>(myIntLine, i, i + this->kmersize, MinimizerValue);
+
+            }
+            else if (CompareLastPSubstringWithMin<MMR>(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
+            {
+                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+                {
+                    copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
+                }
+                SKmerPosStart = i;
+                MinimizerValue = nextCandMin;
+                min_pos = i + this->kmersize - MMR;
+
+            }
+            SKmerPosEnd++;
+        }
+        if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+            (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+            (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+        {
+            copySkmerToBuffer(myline, SKmerPosStart, SKmerPosEnd, MinimizerValue);
+        }
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.getline(myline, this->maxLineLenInFile);
+
+    } while (MyFile.good());
+    MyFile.close();
+}
+
+
+/**
+* This function opens the fastqfile and read one line each time, calculate minimizers and check histograms
+* and then if it is in the range, superkmer including that minimizer will be written into files
+* */
+
+template<int MMR>
+void TopKmerCounting::partitionProcessDiskMethod() {
+    createTempDirs();
+    std::ifstream MyFile;
+    std::vector<std::string> partitionFiles;
+    for (int f = 0; f<this->maxPartitionNumber; f++)
+    {
+        partitionFiles.push_back(partitionFileName(f));
+    }
+    SpillWriter BinFile(*this->ioPool, this->isDirectIOEnabled);
+    if (!BinFile.Open(partitionFiles))
+    {
+        throw std::runtime_error("Error creating partition files in temp directories");
+    }
+
+    MyFile.open(this->fastqFilename, std::ifstream::in);
+
+    if (!MyFile)
+    {
+        throw std::runtime_error("Error opening " + this->fastqFilename);
+    }
+
+    std::unique_ptr<char[]> shrmyline(new char[this->maxLineLenInFile]);
+    char * myline = shrmyline.get();
+    std::unique_ptr<uint64_t[]> shrmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]());
+    uint64_t *myIntLine = shrmyIntLine.get();
+
+    MyFile.ignore(MAXLINELENGTH, '\n');
+    MyFile.getline(myline, this->maxLineLenInFile);
+
+    int line_len;
+
+    uint64_t MinimizerValue, nextCandMin;
+    do {
+        line_len = (int)strlen(myline);
+        if (strspn(myline, "ACGT") != line_len || line_len < this->kmersize)
+        {
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.getline(myline, this->maxLineLenInFile);
+            continue;
+        }
+        convertStringToInt64(myline, myIntLine);
+        int min_pos = findMinimumPSubstring<MMR>(myIntLine, 0, this->kmersize, MinimizerValue);
+        int SKmerPosStart = 0;
+        int SKmerPosEnd = this->kmersize - 1;
+        for (int i = 1; i<line_len - this->kmersize + 1; i++)
+        {
+            if (i>min_pos)
+            {
+                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+                {
+                    spillSkmer(BinFile, myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1, MinimizerValue);
+                }
+                SKmerPosStart = i;
+                min_pos = findMinimumPSubstring<MMR>(myIntLine, i, i + this->kmersize, MinimizerValue);
+
+            }
+            else if (CompareLastPSubstringWithMin<MMR>(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
+            {
+                if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+                    (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+                {
+                    spillSkmer(BinFile, myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1, MinimizerValue);
+                }
+                SKmerPosStart = i;
+                MinimizerValue = nextCandMin;
+                min_pos = i + this->kmersize - MMR;
+
+            }
+            SKmerPosEnd++;
+        }
+        if ((this->minimizerHistogramDiv[((uint32_t)MinimizerValue)] > this->sortedMinimizersDiv[this->maxDepthSearch]) ||
+            (this->minimizerHistogramFac[((uint32_t)MinimizerValue)] > this->sortedMinimizersFac[this->maxDepthSearch]) ||
+            (this->minimizerHistogramSum[((uint32_t)MinimizerValue)] > this->sortedMinimizersSum[this->maxDepthSearch]))
+        {
+            spillSkmer(BinFile, myline + SKmerPosStart, SKmerPosEnd - SKmerPosStart + 1, MinimizerValue);
+        }
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.ignore(MAXLINELENGTH, '\n');
+        MyFile.getline(myline, this->maxLineLenInFile);
+    } while (MyFile.good());
+
+    if (!BinFile.Close())
+    {
+        throw std::runtime_error("Error writing partition files in temp directories");
+    }
+    MyFile.close();
+}
+
+
+
+/**
+* Function:	forEachKmer(const char *, int , KmerConsumer )
+* Packs the first kmer of the superkmer and then rolls one letter at a time,
+* W is known at compile time so shifting a letter into the kmer is a fixed sequence of shifts
+* */
+
+template<int W, class KmerConsumer>
+void TopKmerCounting::forEachKmer(const char *mySuperkmer, int skmerLen, KmerConsumer consume) {
+    if (skmerLen < this->kmersize)
+    {
+        return;
+    }
+    PackedKmer<W> kmer;
+    for (int w = 0; w < W; w++) kmer.word[w] = 0;
+
+    for (int j = 0; j < skmerLen; j++)
+    {
+        for (int w = 0; w < W - 1; w++)
+        {
+            kmer.word[w] = (kmer.word[w] << 2) | (kmer.word[w + 1] >> 62);
+        }
+        kmer.word[W - 1] = (kmer.word[W - 1] << 2) | char2IntTable[mySuperkmer[j] - 'A'];
+        kmer.word[0] &= this->kmerTopWordMask;
+        if (j >= this->kmersize - 1)
+        {
+            consume(kmer);
+        }
+    }
+}
+
+/**
+* Function:	forEachSuperkmer(const char *, size_t , char , SuperkmerConsumer )
+* Walks the superkmers of a partition, '_' delimited in buffers and new line delimited in files
+* */
+
+template<class SuperkmerConsumer>
+void TopKmerCounting::forEachSuperkmer(const char *partitionData, size_t dataLen, char delimiterChar, SuperkmerConsumer consume) {
+    const char *mySuperkmer = partitionData;
+    const char *bufferEnd = partitionData + dataLen;
+    while (mySuperkmer < bufferEnd)
+    {
+        const char *delimiter = (const char *)memchr(mySuperkmer, delimiterChar, bufferEnd - mySuperkmer);
+        if (delimiter == NULL)
+        {
+            delimiter = bufferEnd;
+        }
+        consume(mySuperkmer, (int)(delimiter - mySuperkmer));
+        mySuperkmer = delimiter + 1;
+    }
+}
+
+/**
+* Function:	offerTopCount(const PackedKmer<W> &, int , int , char *)
+* Thread updates its own sorted map if count is bigger than the minimum of the toplist,
+* only kmers entering the toplist are converted back to string
+* */
+
+template<int W>
+void TopKmerCounting::offerTopCount(const PackedKmer<W> &kmer, int count, int threadNo, char *kmerRead) {
+    auto minIt = this->myTopCountTable[threadNo].begin();
+    if (count > minIt->first)
+    {
+        convertPackedKmerToString<W>(kmer, this->kmersize, kmerRead);
+        this->myTopCountTable[threadNo].erase(minIt);
+        this->myTopCountTable[threadNo].insert(std::make_pair(count, std::string(kmerRead)));
+    }
+}
+
+/**
+* Function:	updateTopCountTable(const KmerHashTable<W> &, int )
+* Thread updates its own sorted map by checking all elements in hashtable
+* */
+
+template<int W>
+void TopKmerCounting::updateTopCountTable(const KmerHashTable<W> &kmerHashTable, int threadNo) {
+    std::unique_ptr<char[]> shrkmerRead(new char[this->kmersize + 1]);
+    char * kmerRead = shrkmerRead.get();
+
+    for (auto it = kmerHashTable.begin(); it != kmerHashTable.end(); ++it)
+    {
+        offerTopCount<W>(it->first, it->second, threadNo, kmerRead);
+    }
+}
+
+/**
+* Function:	HashTableProcess(int , int )
+* This function run by different threads and each thread process different filtered partition buffer
+* gets the superkmer and count each kmer in it and insert it into hashtable or increase its counter
+* after that thread will update its own sorted map by checking all elements in hashtable
+* */
+
+template<int W>
+void TopKmerCounting::HashTableProcess(int partNo, int threadNo) {
+
+    if (this->currentUsedBufferSize[partNo] == 0)
+    {
+        return;
+    }
+    localizePartitionBuffer(partNo);
+    KmerHashTable<W> &kmerHashTable = workspace.tables<W>().hashTables[threadNo];
+    kmerHashTable.reserve(this->currentUsedBufferSize[partNo] / this->kmersize);
+
+    forEachSuperkmer(this->filteredData[partNo], this->currentUsedBufferSize[partNo], '_', [this, &kmerHashTable](const char *mySuperkmer, int skmerLen) {
+        this->forEachKmer<W>(mySuperkmer, skmerLen, [&kmerHashTable](const PackedKmer<W> &kmer) { kmerHashTable[kmer]++; });
+    });
+
+    updateTopCountTable<W>(kmerHashTable, threadNo);
+    recycleKmerTables<W>(threadNo);
+
+    releasePartitionBuffer(partNo);
+}
+
+
+/**
+* Function:	HashTableProcessDiskMethod(const char *, size_t , int )
+* Same as HashTableProcess function but for a partition file loaded into memory,
+* superkmers are delimited by new lines instead of '_'
+* */
+
+template<int W>
+void TopKmerCounting::HashTableProcessDiskMethod(const char *partitionData, size_t dataLen, int threadNo) {
+    if (dataLen == 0)
+    {
+        return;
+    }
+    KmerHashTable<W> &kmerHashTable = workspace.tables<W>().hashTables[threadNo];
+
+    forEachSuperkmer(partitionData, dataLen, '\n', [this, &kmerHashTable](const char *mySuperkmer, int skmerLen) {
+        this->forEachKmer<W>(mySuperkmer, skmerLen, [&kmerHashTable](const PackedKmer<W> &kmer) { kmerHashTable[kmer]++; });
+    });
+
+    updateTopCountTable<W>(kmerHashTable, threadNo);
+    recycleKmerTables<W>(threadNo);
+}
+
+
+/**
+* Function:	radixSortPackedKmers(std::vector<PackedKmer<W>> &, int )
+* LSD radix sort of packed kmers, one byte per pass starting from the last letters.
+* A pass is skipped when all kmers have the same byte, common for short kmers in word[0]
+* */
+
+template<int W>
+static void radixSortPackedKmers(std::vector<PackedKmer<W>> &kmers, int keyBits) {
+    const size_t n = kmers.size();
+    if (n < 2)
+    {
+        return;
+    }
+    std::vector<PackedKmer<W>> sortBuffer(n);
+    PackedKmer<W> *src = kmers.data();
+    PackedKmer<W> *dst = sortBuffer.data();
+    size_t bucket[256];
+
+    for (int bit = 0; bit < keyBits; bit += 8)
+    {
+        const int w = W - 1 - (bit >> 6);
+        const int shift = bit & 0x3f;
+        std::fill(bucket, bucket + 256, 0);
+        for (size_t i = 0; i < n; i++) bucket[(src[i].word[w] >> shift) & 0xff]++;
+        if (bucket[(src[0].word[w] >> shift) & 0xff] == n)
+        {
+            continue;
+        }
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            size_t bucketSize = bucket[b];
+            bucket[b] = offset;
+            offset += bucketSize;
+        }
+        for (size_t i = 0; i < n; i++) dst[bucket[(src[i].word[w] >> shift) & 0xff]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != kmers.data())
+    {
+        kmers.swap(sortBuffer);
+    }
+}
+
+/**
+* Function:	sortAndCount(std::vector<PackedKmer<W>> &, int )
+* Sorts the kmers of a partition and counts runs of equal kmers while scanning once,
+* counted kmers are given to the thread toplist
+* */
+
+template<int W>
+void TopKmerCounting::sortAndCount(std::vector<PackedKmer<W>> &kmers, int threadNo) {
+    if (kmers.empty())
+    {
+        return;
+    }
+    radixSortPackedKmers<W>(kmers, this->kmersize * 2);
+
+    std::unique_ptr<char[]> shrkmerRead(new char[this->kmersize + 1]);
+    char * kmerRead = shrkmerRead.get();
+    size_t runStart = 0;
+    for (size_t i = 1; i <= kmers.size(); i++)
+    {
+        if (i == kmers.size() || !(kmers[i] == kmers[runStart]))
+        {
+            offerTopCount<W>(kmers[runStart], (int)(i - runStart), threadNo, kmerRead);
+            runStart = i;
+        }
+    }
+}
+
+/**
+* Function:	packPartitionKmers(const char *, size_t , char , std::vector<PackedKmer<W>> &)
+* Fills the array with all kmers of the superkmers in a partition
+* */
+
+template<int W>
+void TopKmerCounting::packPartitionKmers(const char *partitionData, size_t dataLen, char delimiter, std::vector<PackedKmer<W>> &kmers) {
+    // each superkmer of length L takes L+1 bytes with its delimiter and has L-k+1 kmers
+    int64_t skmerCount = std::count(partitionData, partitionData + dataLen, delimiter);
+    kmers.reserve(std::max<int64_t>(0, (int64_t)dataLen - skmerCount * this->kmersize));
+
+    forEachSuperkmer(partitionData, dataLen, delimiter, [this, &kmers](const char *mySuperkmer, int skmerLen) {
+        this->forEachKmer<W>(mySuperkmer, skmerLen, [&kmers](const PackedKmer<W> &kmer) { kmers.push_back(kmer); });
+    });
+}
+
+/**
+* Function:	SortCountProcess(int , int )
+* Sort and count alternative of HashTableProcess, as in KMC 2.
+* kmers of the partition buffer are packed into an array which is radix sorted and run length counted
+* */
+
+template<int W>
+void TopKmerCounting::SortCountProcess(int partNo, int threadNo) {
+
+    if (this->currentUsedBufferSize[partNo] == 0)
+    {
+        return;
+    }
+    localizePartitionBuffer(partNo);
+    std::vector<PackedKmer<W>> &kmers = workspace.tables<W>().sortArrays[threadNo];
+    packPartitionKmers<W>(this->filteredData[partNo], this->currentUsedBufferSize[partNo], '_', kmers);
+    releasePartitionBuffer(partNo);		// buffer is not needed anymore, sorting needs the memory
+
+    sortAndCount<W>(kmers, threadNo);
+    recycleKmerTables<W>(threadNo);
+}
+
+/**
+* Function:	SortCountProcessDiskMethod(const char *, size_t , int )
+* Same as SortCountProcess function but for a partition file loaded into memory
+* */
+
+template<int W>
+void TopKmerCounting::SortCountProcessDiskMethod(const char *partitionData, size_t dataLen, int threadNo) {
+    std::vector<PackedKmer<W>> &kmers = workspace.tables<W>().sortArrays[threadNo];
+    packPartitionKmers<W>(partitionData, dataLen, '\n', kmers);
+    sortAndCount<W>(kmers, threadNo);
+    recycleKmerTables<W>(threadNo);
+}
+
+/**
+* Function:	recycleKmerTables(int )
+* Empties the hash table and sort array of a thread for its next partition.
+* Clearing a table costs its bucket count, so big ones are dropped instead of kept
+* */
+
+template<int W>
+void TopKmerCounting::recycleKmerTables(int threadNo) {
+    KmerHashTable<W> &kmerHashTable = workspace.tables<W>().hashTables[threadNo];
+    if (kmerHashTable.bucket_count() > RECYCLEDTABLESIZE)
+    {
+        KmerHashTable<W>().swap(kmerHashTable);
+    }
+    else {
+        kmerHashTable.clear();
+    }
+    std::vector<PackedKmer<W>> &kmers = workspace.tables<W>().sortArrays[threadNo];
+    if (kmers.capacity() > RECYCLEDTABLESIZE)
+    {
+        std::vector<PackedKmer<W>>().swap(kmers);
+    }
+    else {
+        kmers.clear();
+    }
+}
+
+
+
+/**
+* Function:	claimPartition()
+* Returns a partition not processed yet and marks it, -1 if all are taken.
+* When NUMA placement is on, a thread first takes partitions of its own node and
+* only then helps other nodes
+* */
+
+int TopKmerCounting::claimPartition() {
+    int myNode = (this->numaPlacement != NUMA_OFF) ? ThreadPool::CurrentNode() : -1;
+    int claimed = -1;
+
+    std::lock_guard<std::mutex> lock(this->partitionMutex);
+    for (int partNo = 0; partNo<this->maxPartitionNumber; partNo++)
+    {
+        if (this->threadFlag[partNo] != 0)
+        {
+            continue;
+        }
+        if (myNode < 0 || partitionNode(partNo) == myNode)
+        {
+            claimed = partNo;
+            break;
+        }
+        if (claimed < 0)
+        {
+            claimed = partNo;				// partition of another node, taken if nothing local is left
+        }
+    }
+    if (claimed >= 0)
+    {
+        this->threadFlag[claimed] = 1;
+    }
+    return claimed;
+}
+
+/**
+* Function:	partition2Table(int )
+* Each thread will run this function and gets the partition buffer which is not processed
+* */
+
+void TopKmerCounting::partition2Table(int threadNo) {
+
+    int partNo;
+    while ((partNo = claimPartition()) >= 0)
+    {
+        (this->*kernels.hashTableProcess)(partNo, threadNo);
+    }
+}
+
+
+/**
+* Function:	partitionFileName(int )
+* Path of the file keeping superkmers of a partition in disk method,
+* partitions are striped over temp directories so every disk gets the same share
+* */
+
+std::string TopKmerCounting::partitionFileName(int partNo) {
+    char buffer[100];
+    sprintf(buffer, "/kmer%d.txt", partNo);
+    return tempDirs[partNo % tempDirs.size()] + buffer;
+}
+
+/**
+* Function:	createTempDirs()
+* Creates a directory unique to this run in every temp root of the config,
+* so concurrent jobs sharing a root and stale directories of killed runs do not collide
+* */
+
+void TopKmerCounting::createTempDirs() {
+    static std::atomic<unsigned> runCounter(0);
+    char buffer[100];
+    tempDirs.clear();
+    for (size_t d = 0; d < tempRootDirs.size(); d++)
+    {
+        std::string tempDir;
+        for (int attempt = 0; ; attempt++)
+        {
+            unsigned clockPart = (unsigned)std::chrono::steady_clock::now().time_since_epoch().count();
+            sprintf(buffer, "/kmertmp-%d-%u-%x", (int)_getpid(), runCounter++, clockPart);
+            tempDir = tempRootDirs[d] + buffer;
+            if (_mkdir(tempDir.c_str()) == 0)
+            {
+                break;
+            }
+            if (errno != EEXIST || attempt == 100)
+            {
+                std::string reason = strerror(errno);
+                removeTempDirs();
+                throw std::runtime_error("Cannot create temp directory in " + tempRootDirs[d] + ": " + reason);
+            }
+        }
+        tempDirs.push_back(tempDir);
+    }
+}
+
+void TopKmerCounting::removeTempDirs() {
+    for (size_t d = 0; d < tempDirs.size(); d++)
+    {
+        _rmdir(tempDirs[d].c_str());
+    }
+    tempDirs.clear();
+}
+
+/**
+* Function:	partition2TableDiskMethod(int )
+* Each thread will run this function and gets the partition file which is not processed.
+* A thread always claims one partition ahead and io threads read it while the current one is counted
+* */
+void TopKmerCounting::partition2TableDiskMethod(int threadNo) {
+
+    int f = claimPartition();
+    std::future<std::vector<char>> current;
+    if (f >= 0)
+    {
+        current = LoadSpillFileAsync(*this->ioPool, partitionFileName(f));
+    }
+    while (f >= 0)
+    {
+        int next = claimPartition();
+        std::future<std::vector<char>> nextLoad;
+        if (next >= 0)
+        {
+            nextLoad = LoadSpillFileAsync(*this->ioPool, partitionFileName(next));
+        }
+        std::vector<char> partitionData = current.get();
+        (this->*kernels.hashTableProcessDiskMethod)(partitionData.data(), partitionData.size(), threadNo);
+        remove(partitionFileName(f).c_str());
+
+        f = next;
+        current = std::move(nextLoad);
+    }
+}
+
+
+/**
+* Function:	HistogramProcess()
+* This function calculates histograms in two different ways
+* 1st: sum of 1/numberofkmers, numberofkmers: which shares the same minimizer in superkmer
+* 2nd: sum of numberofkmers,	numberofkmers: which shares the same minimizer in superkmer
+*
+* some minimizers are unique to one kmer
+* and some minimizers are shared by so many kmers
+*
+* therefore both histogram are usefull to identify top kmers
+* */
+
+template<int MMR>
+void TopKmerCounting::HistogramProcess() {
+
+    std::ifstream MyFile;
+    MyFile.open(this->fastqFilename, std::ifstream::in);
+
+    if (!MyFile)
+    {
+        throw std::runtime_error("Error opening " + this->fastqFilename);
+    }
+    std::unique_ptr<char[]> shrmyline(new char[this->maxLineLenInFile]);
+    char * myline = shrmyline.get();
+    std::unique_ptr<uint64_t[]> shrmyIntLine(new uint64_t[((this->maxLineLenInFile + 31) / 32) + 1]());
+    uint64_t *myIntLine = shrmyIntLine.get();
+    MyFile.ignore(MAXLINELENGTH, '\n');
+    MyFile.getline(myline, this->maxLineLenInFile);
+
+    int line_len;
+    int min_pos;
+    uint64_t MinimizerValue, nextCandMin;
+    int numberOfKmers;
+    do {
+        line_len = (int)strlen(myline);
+        if (strspn(myline, "ACGT") != line_len || line_len < this->kmersize)
+        {
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.getline(myline, this->maxLineLenInFile);
+            continue;
+        }
+        convertStringToInt64(myline, myIntLine);
+        min_pos = findMinimumPSubstring<MMR>(myIntLine, 0, this->kmersize, MinimizerValue);
+        numberOfKmers = 1;
+        for (int i = 1; i<line_len - this->kmersize + 1; i++)
+        {
+            if (i>min_pos)
+            {
+                this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
+                this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
+                this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
+                min_pos = findMinimumPSubstring<MMR>(myIntLine, i, i + this->kmersize, MinimizerValue);
+                numberOfKmers = 1;
+            }
+            else if (CompareLastPSubstringWithMin<MMR>(myIntLine, i + this->kmersize, min_pos, MinimizerValue, nextCandMin))
+            {
+                this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
+                this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
+                this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
+                min_pos = i + this->kmersize - MMR;
+                MinimizerValue = nextCandMin;
+                numberOfKmers = 1;
+            }
+            else {
+                numberOfKmers++;
+            }
+        }
+        this->minimizerHistogramDiv[(uint32_t)MinimizerValue] += (1.0 / ((float)numberOfKmers));
+        this->minimizerHistogramFac[(uint32_t)MinimizerValue] += numberOfKmers;
+        this->minimizerHistogramSum[(uint32_t)MinimizerValue] ++;
+        for (int j = 0; j<this->histogramReadRate && MyFile.good(); j++)
+        {
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.ignore(MAXLINELENGTH, '\n');
+            MyFile.getline(myline, this->maxLineLenInFile);
+        }
+    } while (MyFile.good());
+    MyFile.close();
+}
+
+uint64_t getSizeofFile(const char *filename) {
+    std::ifstream MyFile;
+    MyFile.open(filename, std::ifstream::in);
+    if (!MyFile)
+    {
+        throw std::runtime_error(std::string("Error opening ") + filename);
+    }
+    MyFile.seekg(0, MyFile.end);
+    uint64_t length = MyFile.tellg();
+    MyFile.close();
+    return length;
+}
@@ -1,85 +1,250 @@
-#ifndef __MYLIB_H__
-#define __MYLIB_H__
-
-#include <string>
-#include <mutex>
-#include <queue>
-#include <memory>
-
-#if defined(_WIN32) || defined(_WIN64)
-/* We are on Windows */
-# define strtok_r strtok_s
-#endif
-
-const uint32_t char2IntTable[30] = { 0,0,1,0,0,0,2,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,0,0,0,0,0,0,0,0 };
-const uint32_t Int2charTable[4] = { 0,2,6,19 }; // i.e. A,C,G,T letters
-const uint64_t andTable[] =
-{ 0,0x1,0x3,0x7,0xf,0x1f,0x3f,0x7f,0xff,0x1ff,0x3ff,0x7ff,0xfff,0x1fff,0x3fff,0x7fff,0xffff,
-0x1ffff,0x3ffff,0x7ffff,0xfffff,0x1fffff,0x3fffff,0x7fffff,0xffffff,0x1ffffff,0x3ffffff,
-0x7ffffff,0xfffffff,0x1fffffff,0x3fffffff,0x7fffffff,0xffffffff,0x1ffffffff,0x3ffffffff,
-0x7ffffffff,0xfffffffff,0x1fffffffff,0x3fffffffff,0x7fffffffff,0xffffffffff,0x1ffffffffff,
-0x3ffffffffff,0x7ffffffffff,0xfffffffffff,0x1fffffffffff,0x3fffffffffff,0x7fffffffffff,0xffffffffffff,
-0x1ffffffffffff,0x3ffffffffffff,0x7ffffffffffff,0xfffffffffffff,0x1fffffffffffff,0x3fffffffffffff,
-0x7fffffffffffff,0xffffffffffffff,0x1ffffffffffffff,0x3ffffffffffffff,0x7ffffffffffffff,0xfffffffffffffff,
-0x1fffffffffffffff,0x3fffffffffffffff,0x7fffffffffffffff,0xffffffffffffffff };
-
-
-class TopKmerCounting {
-private:
-    const int kmersize;									    // Length of the kmer that will be searched
-    const int topcount;									    // Size of top list wanted
-    std::string fastqFilename;                              // Name of FASTQ file given
-    int mmrLen;										        // Length of the minimizer of kmers, default value will be 10
-    const int maxLineLenInFile;                             // Max line length of FASTQ file
-    int maxDepthSearch;                                     // Max depth for filtering before count, default value topcount*2
-    const int maxPartitionNumber;                           // max partition number, default value 256
-    std::unique_ptr<float[]> minimizerHistogramDiv;         // Sorted Histogram for minimizers multiplied by the number of kmers sharing the same minimizer in a single
-    std::unique_ptr<float[]> sortedMinimizersDiv;           // Same as minimizerHistogramDiv but  sorted
-    int nThreads;                                           // thread numbers
-    int *threadFlag;                                        // thread flags to prevent two or more threads to process same data in a partition
-    std::mutex partitionMutex;                              // thread lock to modify thradFlag
-    int isDiskMethodEnabled;
-    int isBigFileEnabled;
-    int histogramReadRate;                                  // if it is 1 then histogram is done by reading whole file and if it is 2, just half and so on
-    std::unique_ptr<uint32_t[]> minimizerHistogramFac;      // Sorted Histogram for minimizers divided by the number of kmers sharing the same minimizer in a single
-    std::unique_ptr<uint32_t[]> sortedMinimizersFac;        // Same as minimizerHistogramFac but sorted
-
-    std::unique_ptr<uint32_t[]> minimizerHistogramSum;      // Sorted Histogram for minimizers increased by one for each superkmer
-    std::unique_ptr<uint32_t[]> sortedMinimizersSum;        // Same as minimizerHistogramFac but  sorted
-    char **filteredData;                                    // buffer to keep filtered data, each partition has different dimension
-
-    uint32_t *currentUsedBufferSize;                        // current buffer length which has been used
-    uint32_t *currentBufferSize;                            // current allocated buffer length
-
-    std::multimap<int, std::string> *myTopCountTable;       // each thread should have its own topList table
-        
-    void RunProcessInDISK();                                // main function to start counting
-    void RunProcessInRAM();                                 // main function to start counting
-    void partitionProcess();
-    void HashTableProcess(int p, int t);
-    void partition2Table(int t);
-    void partitionProcessDiskMethod();
-    void HashTableProcessDiskMethod(char *Partitionfilename, int t);
-    void partition2TableDiskMethod(int t);
-    void HistogramProcess();
-    void copySkmerToBuffer(char *myline, int startpos, int endpos, uint64_t &MinimizerValue);
-public:
-    TopKmerCounting(char *filename, int givenKmerSize, int givenTopCount);
-    ~TopKmerCounting();
-    void StartCounting();                                   // main function to start counting
-    void DisplayTopList();                                  // Displays the top list
-};
-
-static void convertStringToInt64(const char *GSeq, uint64_t *GSeqInt);
-static int CheckBadMinSubstring(uint64_t nextCand);
-static int CompareLastPSubstringWithMin(const uint64_t *GSeq, int endPos, int MinSubPos, uint64_t &minCand, uint64_t &nextCand);
-static int findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue);
-uint64_t getSizeofFile(const char *filename);
-
-
-//void	convertInt64ToString(const uint64_t *GSeqInt, char *GSeq, int char_len);
-//int	CheckBadMinSubstring(const char *GSeq, int i);
-//int	getMinimizerValue(const char *GSeq, int MinSubPos);
-//int	findMinimumPSubstring(const char *GSeq, int startPos, int endPos);
-
-#endif
+#ifndef __MYLIB_H__
+#define __MYLIB_H__
+
+#include <string>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <cstdint>
+
+#include "threadpool.h"
+#include "spillio.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+/* We are on Windows */
+# define strtok_r strtok_s
+#endif
+
+const uint32_t char2IntTable[30] = { 0,0,1,0,0,0,2,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,0,0,0,0,0,0,0,0 };
+const uint32_t Int2charTable[4] = { 0,2,6,19 }; // i.e. A,C,G,T letters
+const uint64_t andTable[] =
+{ 0,0x1,0x3,0x7,0xf,0x1f,0x3f,0x7f,0xff,0x1ff,0x3ff,0x7ff,0xfff,0x1fff,0x3fff,0x7fff,0xffff,
+0x1ffff,0x3ffff,0x7ffff,0xfffff,0x1fffff,0x3fffff,0x7fffff,0xffffff,0x1ffffff,0x3ffffff,
+0x7ffffff,0xfffffff,0x1fffffff,0x3fffffff,0x7fffffff,0xffffffff,0x1ffffffff,0x3ffffffff,
+0x7ffffffff,0xfffffffff,0x1fffffffff,0x3fffffffff,0x7fffffffff,0xffffffffff,0x1ffffffffff,
+0x3ffffffffff,0x7ffffffffff,0xfffffffffff,0x1fffffffffff,0x3fffffffffff,0x7fffffffffff,0xffffffffffff,
+0x1ffffffffffff,0x3ffffffffffff,0x7ffffffffffff,0xfffffffffffff,0x1fffffffffffff,0x3fffffffffffff,
+0x7fffffffffffff,0xffffffffffffff,0x1ffffffffffffff,0x3ffffffffffffff,0x7ffffffffffffff,0xfffffffffffffff,
+0x1fffffffffffffff,0x3fffffffffffffff,0x7fffffffffffffff,0xffffffffffffffff };
+
+const int MAXKMERWORDS = 3;                                 // 90 letters need 180 bits i.e. three 64bit words
+const int MAXMINIMIZERLEN = 10;                             // default minimizer length is also the longest one
+
+/**
+* A kmer packed 2 bits per letter into W 64bit words, word[W-1] keeps the last 32 letters
+* and word[0] keeps the remaining letters on its low bits
+* */
+enum CountingEngine {
+    ENGINE_HASH,                                            // each partition is counted in an unordered_map
+    ENGINE_SORT                                             // each partition is radix sorted and counted by scanning (KMC 2)
+};
+
+/**
+* Everything a counting job needs. Instances are independent, many jobs may run at the same time
+* sharing one ThreadPool.
+* */
+struct CountingConfig {
+    std::string fastqFilename;
+    int kmerSize;
+    int topCount;
+    CountingEngine engine;                                  // hashing or sorting for counting partitions
+    NumaPlacement numaPlacement;                            // threadPool should be pinned if it is not NUMA_OFF
+    bool directIO;                                          // partition files of disk method are opened with O_DIRECT
+    std::vector<std::string> tempDirs;                      // partition files are striped over dirs, default is working directory
+    int shardIndex;                                         // only partitions p with p % shardCount == shardIndex are counted
+    int shardCount;
+
+    CountingConfig() :kmerSize(0), topCount(0), engine(ENGINE_HASH), numaPlacement(NUMA_OFF), directIO(false), shardIndex(0), shardCount(1) {}
+};
+
+struct KmerCount {
+    std::string kmer;
+    int count;
+};
+typedef std::vector<KmerCount> TopKmerList;
+
+template<int W>
+struct PackedKmer {
+    uint64_t word[W];
+    bool operator==(const PackedKmer &other) const {
+        for (int i = 0; i < W; i++)
+        {
+            if (word[i] != other.word[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template<int W>
+struct PackedKmerHash {
+    size_t operator()(const PackedKmer<W> &kmer) const {
+        uint64_t h = kmer.word[0];
+        for (int i = 1; i < W; i++)
+        {
+            h = (h ^ (h >> 31)) * 0x9e3779b97f4a7c15ULL + kmer.word[i];
+        }
+        h ^= h >> 33;                                       // murmur3 finalizer, low bits of a kmer are not random enough
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return (size_t)h;
+    }
+};
+
+template<int W>
+using KmerHashTable = std::unordered_map<PackedKmer<W>, int, PackedKmerHash<W>>;
+
+/**
+* Per thread hash tables and sort arrays of one kmer width, kept between partitions and jobs
+* */
+template<int W>
+struct KmerTables {
+    std::vector<KmerHashTable<W>> hashTables;
+    std::vector<std::vector<PackedKmer<W>>> sortArrays;
+};
+
+/**
+* Memory reused by consecutive counting jobs: histograms, partition buffers and per thread
+* hash tables and sort arrays. Only small partition buffers and tables are kept, so one big job
+* does not pin its memory. A workspace may be used by one job at a time.
+* */
+class CountingWorkspace {
+    friend class TopKmerCounting;
+private:
+    int histogramSize;                                      // entries allocated in each histogram
+    std::unique_ptr<float[]> minimizerHistogramDiv;
+    std::unique_ptr<float[]> sortedMinimizersDiv;
+    std::unique_ptr<uint32_t[]> minimizerHistogramFac;
+    std::unique_ptr<uint32_t[]> sortedMinimizersFac;
+    std::unique_ptr<uint32_t[]> minimizerHistogramSum;
+    std::unique_ptr<uint32_t[]> sortedMinimizersSum;
+    int partitionCount;
+    char **filteredData;
+    uint32_t *currentUsedBufferSize;
+    uint32_t *currentBufferSize;
+    bool nodeBoundBuffers;                                  // buffers were allocated by AllocateOnNode
+    std::tuple<KmerTables<1>, KmerTables<2>, KmerTables<3>> kmerTables;
+
+    void prepare(int givenHistogramSize, int threadCount, bool nodeBound);
+    void freeBuffers();
+    template<int W> KmerTables<W> &tables() { return std::get<W - 1>(kmerTables); }
+public:
+    CountingWorkspace();
+    ~CountingWorkspace();
+};
+
+
+class TopKmerCounting {
+private:
+    const int kmersize;									    // Length of the kmer that will be searched
+    const int topcount;									    // Size of top list wanted
+    std::string fastqFilename;                              // Name of FASTQ file given
+    const int mmrLen;										// Length of the minimizer of kmers, default value will be 10
+    const int maxLineLenInFile;                             // Max line length of FASTQ file
+    int maxDepthSearch;                                     // Max depth for filtering before count, default value topcount*2
+    const int maxPartitionNumber;                           // max partition number, default value 256
+    int shardIndex;                                         // partitions owned by this process, all of them if shardCount is 1
+    int shardCount;
+    std::unique_ptr<CountingWorkspace> ownedWorkspace;      // if no workspace is given, job has its own one
+    CountingWorkspace &workspace;                           // memory reused by jobs
+    float *minimizerHistogramDiv;                           // Sorted Histogram for minimizers multiplied by the number of kmers sharing the same minimizer in a single
+    float *sortedMinimizersDiv;                             // Same as minimizerHistogramDiv but  sorted
+    ThreadPool &threadPool;                                 // workers shared by all counting phases
+    int nThreads;                                           // thread numbers, size of threadPool
+    NumaPlacement numaPlacement;                            // where partition buffers are put
+    int *threadFlag;                                        // thread flags to prevent two or more threads to process same data in a partition
+    std::mutex partitionMutex;                              // thread lock to modify thradFlag
+    int isDiskMethodEnabled;
+    int isDirectIOEnabled;                                  // partition files are opened with O_DIRECT
+    std::unique_ptr<ThreadPool> ioPool;                     // io threads of disk method, exists only while it runs
+    std::vector<std::string> tempRootDirs;                  // where partition files go, default is working directory
+    std::vector<std::string> tempDirs;                      // directories of this run, one in each root
+    int isBigFileEnabled;
+    int histogramReadRate;                                  // if it is 1 then histogram is done by reading whole file and if it is 2, just half and so on
+    uint32_t *minimizerHistogramFac;                        // Sorted Histogram for minimizers divided by the number of kmers sharing the same minimizer in a single
+    uint32_t *sortedMinimizersFac;                          // Same as minimizerHistogramFac but sorted
+
+    uint32_t *minimizerHistogramSum;                        // Sorted Histogram for minimizers increased by one for each superkmer
+    uint32_t *sortedMinimizersSum;                          // Same as minimizerHistogramFac but  sorted
+    char **filteredData;                                    // buffer to keep filtered data, each partition has different dimension
+
+    uint32_t *currentUsedBufferSize;                        // current buffer length which has been used
+    uint32_t *currentBufferSize;                            // current allocated buffer length
+
+    std::multimap<int, std::string> *myTopCountTable;       // each thread should have its own topList table
+
+    // Kernels specialized on minimizer length (MMR) and on 64bit words per kmer (W), chosen once in constructor
+    struct CountingKernels {
+        void (TopKmerCounting::*histogramProcess)();
+        void (TopKmerCounting::*partitionProcess)();
+        void (TopKmerCounting::*partitionProcessDiskMethod)();
+        void (TopKmerCounting::*hashTableProcess)(int p, int t);
+        void (TopKmerCounting::*hashTableProcessDiskMethod)(const char *partitionData, size_t dataLen, int t);
+    };
+    CountingKernels kernels;
+    uint64_t kmerTopWordMask;                               // mask for the most significant word of a packed kmer
+
+    CountingEngine countingEngine;                          // hashing or sorting for counting partitions
+
+    static CountingKernels selectKernels(int kmerWords, int minimizerLen, CountingEngine engine);
+
+    void RunProcessInDISK();                                // main function to start counting
+    void RunProcessInRAM();                                 // main function to start counting
+    template<int MMR> void partitionProcess();
+    template<int W> void HashTableProcess(int p, int t);
+    void partition2Table(int t);
+    template<int MMR> void partitionProcessDiskMethod();
+    template<int W> void HashTableProcessDiskMethod(const char *partitionData, size_t dataLen, int t);
+    void partition2TableDiskMethod(int t);
+    std::string partitionFileName(int p);
+    void createTempDirs();
+    void removeTempDirs();
+    template<int MMR> void HistogramProcess();
+    template<int W> void SortCountProcess(int p, int t);
+    template<int W> void SortCountProcessDiskMethod(const char *partitionData, size_t dataLen, int t);
+    template<int W> void packPartitionKmers(const char *partitionData, size_t dataLen, char delimiter, std::vector<PackedKmer<W>> &kmers);
+    template<int W> void sortAndCount(std::vector<PackedKmer<W>> &kmers, int t);
+    template<int W, class KmerConsumer> void forEachKmer(const char *mySuperkmer, int skmerLen, KmerConsumer consume);
+    template<class SuperkmerConsumer> void forEachSuperkmer(const char *partitionData, size_t dataLen, char delimiter, SuperkmerConsumer consume);
+    template<int W> void offerTopCount(const PackedKmer<W> &kmer, int count, int t, char *kmerRead);
+    template<int W> void updateTopCountTable(const KmerHashTable<W> &kmerHashTable, int t);
+    template<int W> void recycleKmerTables(int t);
+    void copySkmerToBuffer(char *myline, int startpos, int endpos, uint64_t &MinimizerValue);
+    void spillSkmer(SpillWriter &spillWriter, const char *skmer, int skmerLen, uint64_t MinimizerValue);
+    bool ownsPartition(uint32_t p) const { return shardCount == 1 || (int)(p % shardCount) == shardIndex; }
+    int partitionNode(int p);
+    void growPartitionBuffer(int p);
+    void releasePartitionBuffer(int p);
+    void freePartitionBuffer(int p);
+    void localizePartitionBuffer(int p);
+    int claimPartition();
+public:
+    TopKmerCounting(const CountingConfig &config, ThreadPool &givenThreadPool, CountingWorkspace *givenWorkspace = NULL);  // throws std::invalid_argument for bad config
+    ~TopKmerCounting();
+    void StartCounting();                                   // main function to start counting, throws std::runtime_error on io errors
+    TopKmerList GetTopList() const;                         // most frequent first
+    void DisplayTopList(std::ostream &out = std::cout) const;  // Displays the top list
+};
+
+static void convertStringToInt64(const char *GSeq, uint64_t *GSeqInt);
+template<int MMR> static uint64_t getPSubstring(const uint64_t *GSeq, int pos);
+template<int MMR> static int CheckBadMinSubstring(uint64_t nextCand);
+template<int MMR> static int CompareLastPSubstringWithMin(const uint64_t *GSeq, int endPos, int MinSubPos, uint64_t &minCand, uint64_t &nextCand);
+template<int MMR> static int findMinimumPSubstring(const uint64_t *GSeq, int startPos, int endPos, uint64_t &MinimizerValue);
+template<int W> static void convertPackedKmerToString(const PackedKmer<W> &kmer, int char_len, char *GSeq);
+uint64_t getSizeofFile(const char *filename);
+
+
+//void	convertInt64ToString(const uint64_t *GSeqInt, char *GSeq, int char_len);
+//int	CheckBadMinSubstring(const char *GSeq, int i);
+//int	getMinimizerValue(const char *GSeq, int MinSubPos);
+//int	findMinimumPSubstring(const char *GSeq, int startPos, int endPos);
+
+#endif
@@ -1,19 +1,222 @@
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <fstream>
 
 #include "mylib.h"
+#include "threadpool.h"
+#include "server.h"
+#include "shard.h"
+
+// merge subcommand: combines "--shard i/n" outputs of all shards into the global toplist
+static int mergeShards(int fileCount, char **files){
+    std::vector<PartialTopList> partials;
+    try {
+	for(int f = 0; f < fileCount; f++){
+	    std::ifstream in(files[f]);
+	    if(!in)
+		throw std::runtime_error(std::string("Error opening ") + files[f]);
+	    partials.push_back(ReadPartialTopList(in, files[f]));
+	}
+	TopKmerList merged = MergePartialTopLists(partials);
+	for(size_t i = 0; i < merged.size(); i++)
+	    std::cout << merged[i].kmer << " " << merged[i].count << "\n";
+	std::cout.flush();
+    }
+    catch(const std::exception &e){
+	std::cerr << "Error: " << e.what() << std::endl;
+	return 1;
+    }
+    return 0;
+}
 
 int main(int argc, char **argv){
-    if(argc < 4){
-	std::cerr << "Usage: " << argv[0] << " fastqfilename kmersize topcount" << std::endl;
+    if(argc > 1 && !strcmp(argv[1], "merge"))
+	return mergeShards(argc - 2, argv + 2);
+
+    CountingEngine engine = ENGINE_HASH;
+    NumaPlacement numa = NUMA_OFF;
+    int threads = 0;
+    bool pin = false;
+    bool directIO = false;
+    std::vector<std::string> tmpDirs;
+    std::string serveSocket, connectSocket;
+    int maxJobs = 2;
+    int shardIndex = 0, shardCount = 1;
+    bool sharded = false;
+    int argi = 1;
+    while(argi < argc && !strncmp(argv[argi], "--", 2)){
+	if(!strcmp(argv[argi], "--engine") && argi + 1 < argc){
+	    if(!strcmp(argv[argi + 1], "hash"))
+		engine = ENGINE_HASH;
+	    else if(!strcmp(argv[argi + 1], "sort"))
+		engine = ENGINE_SORT;
+	    else {
+		std::cerr << "Unknown engine " << argv[argi + 1] << ", use hash or sort" << std::endl;
+		return 0;
+	    }
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--threads") && argi + 1 < argc){
+	    threads = atoi(argv[argi + 1]);
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--pin")){
+	    pin = true;
+	    argi++;
+	}
+	else if(!strcmp(argv[argi], "--tmp") && argi + 1 < argc){
+	    // comma separated list, option may also be repeated
+	    std::string dirs(argv[argi + 1]);
+	    size_t start = 0, comma;
+	    do {
+		comma = dirs.find(',', start);
+		std::string dir = dirs.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+		if(!dir.empty())
+		    tmpDirs.push_back(dir);
+		start = comma + 1;
+	    } while(comma != std::string::npos);
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--serve") && argi + 1 < argc){
+	    serveSocket = argv[argi + 1];
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--connect") && argi + 1 < argc){
+	    connectSocket = argv[argi + 1];
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--shard") && argi + 1 < argc){
+	    if(sscanf(argv[argi + 1], "%d/%d", &shardIndex, &shardCount) != 2){
+		std::cerr << "Shard must be given as i/n" << std::endl;
+		return 0;
+	    }
+	    sharded = true;
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--jobs") && argi + 1 < argc){
+	    maxJobs = atoi(argv[argi + 1]);
+	    argi += 2;
+	}
+	else if(!strcmp(argv[argi], "--direct-io")){
+	    directIO = true;
+	    argi++;
+	}
+	else if(!strcmp(argv[argi], "--numa") && argi + 1 < argc){
+	    if(!strcmp(argv[argi + 1], "off"))
+		numa = NUMA_OFF;
+	    else if(!strcmp(argv[argi + 1], "first-touch"))
+		numa = NUMA_FIRST_TOUCH;
+	    else if(!strcmp(argv[argi + 1], "explicit"))
+		numa = NUMA_EXPLICIT;
+	    else {
+		std::cerr << "Unknown numa placement " << argv[argi + 1] << ", use off, first-touch or explicit" << std::endl;
+		return 0;
+	    }
+	    pin = pin || numa != NUMA_OFF;	// placement needs to know the node of each thread
+	    argi += 2;
+	}
+	else {
+	    std::cerr << "Unknown option " << argv[argi] << std::endl;
+	    return 0;
+	}
+    }
+
+    if(!serveSocket.empty()){
+	if(sharded){
+	    std::cerr << "--shard cannot be used with --serve" << std::endl;
+	    return 0;
+	}
+	CountingConfig jobDefaults;
+	jobDefaults.engine = engine;
+	jobDefaults.numaPlacement = numa;
+	jobDefaults.directIO = directIO;
+	jobDefaults.tempDirs = tmpDirs;
+	ThreadPool pool(threads, pin);
+	CountingServer server(serveSocket, jobDefaults, pool, maxJobs);
+	return server.Run();
+    }
+
+    if(argc - argi < 3 || (argc - argi) % 3 != 0){
+	std::cerr << "Usage: " << argv[0] << " [--engine hash|sort] [--threads n] [--pin] [--numa off|first-touch|explicit] [--tmp dir1,dir2,..] [--direct-io]"
+		  << " [--connect socket] fastqfilename kmersize topcount [fastqfilename kmersize topcount ...]" << std::endl;
+	std::cerr << "       " << argv[0] << " [options] --serve socket [--jobs n]" << std::endl;
+	std::cerr << "       " << argv[0] << " [options] --shard i/n fastqfilename kmersize topcount > shard_i" << std::endl;
+	std::cerr << "       " << argv[0] << " merge shard_0 shard_1 ..." << std::endl;
 	return 0;
     }
 
-    TopKmerCounting mykmer(argv[1],atoi(argv[2]),atoi(argv[3]));
-    mykmer.StartCounting();
-    mykmer.DisplayTopList();
-    return 0;
+    // every fastqfilename kmersize topcount triple is a separate job, all jobs share one pool
+    std::vector<CountingConfig> configs;
+    for(; argi + 2 < argc; argi += 3){
+	CountingConfig config;
+	config.fastqFilename = argv[argi];
+	config.kmerSize = atoi(argv[argi + 1]);
+	config.topCount = atoi(argv[argi + 2]);
+	config.engine = engine;
+	config.numaPlacement = numa;
+	config.directIO = directIO;
+	config.tempDirs = tmpDirs;
+	config.shardIndex = shardIndex;
+	config.shardCount = shardCount;
+	configs.push_back(config);
+    }
 
-}
+    if(sharded && (configs.size() > 1 || !connectSocket.empty())){
+	std::cerr << "--shard takes a single fastqfilename kmersize topcount and cannot be sent to a server" << std::endl;
+	return 0;
+    }
+
+    if(!connectSocket.empty())
+	return RunClient(connectSocket, configs, std::cout);
 
+    ThreadPool pool(threads, pin);
+    std::vector<TopKmerList> results(configs.size());
+    std::vector<std::string> errors(configs.size());
+    std::vector<std::thread> jobs;
+    for(size_t j = 0; j < configs.size(); j++){
+	jobs.push_back(std::thread([&, j]{
+	    try {
+		TopKmerCounting mykmer(configs[j], pool);
+		mykmer.StartCounting();
+		results[j] = mykmer.GetTopList();
+	    }
+	    catch(const std::exception &e){
+		errors[j] = e.what();
+	    }
+	}));
+    }
+    for(size_t j = 0; j < jobs.size(); j++)
+	jobs[j].join();
+
+    int status = 0;
+    for(size_t j = 0; j < configs.size(); j++){
+	if(configs.size() > 1)
+	    std::cout << "# " << configs[j].fastqFilename << " " << configs[j].kmerSize << " " << configs[j].topCount << std::endl;
+	if(!errors[j].empty()){
+	    std::cerr << "Error: " << errors[j] << std::endl;
+	    status = 1;
+	    continue;
+	}
+	if(sharded){
+	    PartialTopList partial;
+	    partial.shardIndex = shardIndex;
+	    partial.shardCount = shardCount;
+	    partial.kmerSize = configs[j].kmerSize;
+	    partial.topCount = configs[j].topCount;
+	    partial.kmers = results[j];
+	    WritePartialTopList(std::cout, partial);
+	    continue;
+	}
+	for(size_t i = 0; i < results[j].size(); i++)
+	    std::cout << results[j][i].kmer << " " << results[j][i].count << "\n";
+	std::cout.flush();
+    }
+    return status;
+
+}
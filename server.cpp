@@ -0,0 +1,345 @@
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <thread>
+#include <stdexcept>
+
+#if defined(_WIN32) || defined(_WIN64)
+/* We are on Windows */
+
+#else
+
+/* We are on Non-Windows */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "server.h"
+
+CountingServer::CountingServer(const std::string &givenSocketPath, const CountingConfig &givenJobDefaults, ThreadPool &givenThreadPool, int givenMaxJobs)
+    :socketPath(givenSocketPath), jobDefaults(givenJobDefaults), threadPool(givenThreadPool), maxJobs(givenMaxJobs < 1 ? 1 : givenMaxJobs)
+{
+}
+
+/**
+* Function:	acquireWorkspace()
+* Gives an idle workspace, a new one if less than maxJobs exist, otherwise waits for a job to finish
+* */
+
+CountingWorkspace *CountingServer::acquireWorkspace() {
+    std::unique_lock<std::mutex> lock(workspaceMutex);
+    workspaceCondition.wait(lock, [this] { return !idleWorkspaces.empty() || (int)workspaces.size() < maxJobs; });
+    if (!idleWorkspaces.empty())
+    {
+        CountingWorkspace *workspace = idleWorkspaces.back();
+        idleWorkspaces.pop_back();
+        return workspace;
+    }
+    workspaces.push_back(std::unique_ptr<CountingWorkspace>(new CountingWorkspace()));
+    return workspaces.back().get();
+}
+
+void CountingServer::releaseWorkspace(CountingWorkspace *workspace) {
+    {
+        std::lock_guard<std::mutex> lock(workspaceMutex);
+        idleWorkspaces.push_back(workspace);
+    }
+    workspaceCondition.notify_one();
+}
+
+/**
+* Function:	runJob(const std::string &)
+* Runs one COUNT request and returns the whole answer including the closing OK or ERROR line
+* */
+
+std::string CountingServer::runJob(const std::string &request) {
+    CountingConfig config = jobDefaults;
+    int pathStart = 0;
+    if (sscanf(request.c_str(), "COUNT %d %d %n", &config.kmerSize, &config.topCount, &pathStart) < 2 || pathStart == 0 || pathStart >= (int)request.size())
+    {
+        return "ERROR expected COUNT kmersize topcount fastqfilename\n";
+    }
+    config.fastqFilename = request.substr(pathStart);
+
+    std::string answer;
+    CountingWorkspace *workspace = acquireWorkspace();
+    try
+    {
+        TopKmerCounting job(config, threadPool, workspace);
+        job.StartCounting();
+        TopKmerList topList = job.GetTopList();
+        for (size_t i = 0; i < topList.size(); i++)
+        {
+            answer += topList[i].kmer + " " + std::to_string(topList[i].count) + "\n";
+        }
+        answer += "OK\n";
+    }
+    catch (const std::exception &e)
+    {
+        answer = std::string("ERROR ") + e.what() + "\n";
+    }
+    releaseWorkspace(workspace);
+    return answer;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+void CountingServer::serveConnection(int fd) {
+    (void)fd;
+}
+
+int CountingServer::Run() {
+    std::cerr << "Server mode needs Unix domain sockets, it is not supported on Windows" << std::endl;
+    return 1;
+}
+
+int RunClient(const std::string &socketPath, const std::vector<CountingConfig> &jobs, std::ostream &out) {
+    (void)socketPath; (void)jobs; (void)out;
+    std::cerr << "Server mode needs Unix domain sockets, it is not supported on Windows" << std::endl;
+    return 1;
+}
+
+#else
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+/**
+* Function:	readLine(int , std::string &, std::string &)
+* Reads the next '\n' terminated line, bytes after it stay in pending for the next call
+* */
+
+static bool readLine(int fd, std::string &pending, std::string &line) {
+    for (;;)
+    {
+        size_t newline = pending.find('\n');
+        if (newline != std::string::npos)
+        {
+            line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            return true;
+        }
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        pending.append(buffer, n);
+    }
+}
+
+static bool makeSocketAddress(const std::string &socketPath, sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path is too long: " << socketPath << std::endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    return true;
+}
+
+void CountingServer::serveConnection(int fd) {
+    std::string pending, request;
+    while (readLine(fd, pending, request))
+    {
+        if (!sendAll(fd, runJob(request)))
+        {
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(connectionMutex);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        if (connections[i] == fd)
+        {
+            connections.erase(connections.begin() + i);
+            break;
+        }
+    }
+    close(fd);						// closed under the lock so Run cannot shut down a reused descriptor
+    connectionCondition.notify_all();
+}
+
+/**
+* Function:	Run()
+* Listens on socketPath and serves each connection in its own thread. A socket file left by a killed
+* server is replaced, a running server is not. On SIGINT or SIGTERM open connections are shut down,
+* running jobs finish and the socket file is removed.
+* */
+
+int CountingServer::Run() {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address))
+    {
+        return 1;
+    }
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        std::cerr << "Cannot create socket: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    int bound = bind(listenFd, (sockaddr*)&address, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE)
+    {
+        int probeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool alive = (probeFd >= 0 && connect(probeFd, (sockaddr*)&address, sizeof(address)) == 0);
+        if (probeFd >= 0)
+        {
+            close(probeFd);
+        }
+        if (alive)
+        {
+            std::cerr << "A server is already listening on " << socketPath << std::endl;
+            close(listenFd);
+            return 1;
+        }
+        unlink(socketPath.c_str());
+        bound = bind(listenFd, (sockaddr*)&address, sizeof(address));
+    }
+    if (bound != 0 || listen(listenFd, SOMAXCONN) != 0)
+    {
+        std::cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        return 1;
+    }
+
+    stopRequested = 0;
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!stopRequested)
+    {
+        pollfd listenPoll;
+        listenPoll.fd = listenFd;
+        listenPoll.events = POLLIN;
+        if (poll(&listenPoll, 1, 200) <= 0)
+        {
+            continue;					// timeout or signal, check stopRequested again
+        }
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            connections.push_back(fd);
+        }
+        std::thread([this, fd] { this->serveConnection(fd); }).detach();
+    }
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+    std::unique_lock<std::mutex> lock(connectionMutex);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        shutdown(connections[i], SHUT_RDWR);		// idle clients are waiting in recv
+    }
+    connectionCondition.wait(lock, [this] { return connections.empty(); });
+    return 0;
+}
+
+/**
+* Function:	RunClient(const std::string &, const std::vector<CountingConfig> &, std::ostream &)
+* Sends jobs to a server one by one and prints their results in the same format as a local run.
+* File names are made absolute since the server may run in another directory
+* */
+
+int RunClient(const std::string &socketPath, const std::vector<CountingConfig> &jobs, std::ostream &out) {
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address))
+    {
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        std::cerr << "Cannot connect to " << socketPath << ": " << strerror(errno) << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int status = 0;
+    std::string pending, line;
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        char resolved[PATH_MAX];
+        std::string path = realpath(jobs[j].fastqFilename.c_str(), resolved) ? resolved : jobs[j].fastqFilename;
+        if (!sendAll(fd, "COUNT " + std::to_string(jobs[j].kmerSize) + " " + std::to_string(jobs[j].topCount) + " " + path + "\n"))
+        {
+            std::cerr << "Connection to server lost" << std::endl;
+            status = 1;
+            break;
+        }
+        if (jobs.size() > 1)
+            out << "# " << jobs[j].fastqFilename << " " << jobs[j].kmerSize << " " << jobs[j].topCount << "\n";
+        bool finished = false;
+        while (!finished && readLine(fd, pending, line))
+        {
+            if (line == "OK")
+            {
+                finished = true;
+            }
+            else if (line.compare(0, 6, "ERROR ") == 0)
+            {
+                std::cerr << "Error: " << line.substr(6) << std::endl;
+                status = 1;
+                finished = true;
+            }
+            else {
+                out << line << "\n";
+            }
+        }
+        out.flush();
+        if (!finished)
+        {
+            std::cerr << "Connection to server lost" << std::endl;
+            status = 1;
+            break;
+        }
+    }
+    close(fd);
+    return status;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+
+#include "mylib.h"
+#include "threadpool.h"
+
+/**
+* Daemon mode. Jobs come as lines on a Unix domain socket:
+*	COUNT kmersize topcount fastqfilename
+* and each is answered by its toplist, one "kmer count" line per kmer, followed by "OK" or "ERROR message".
+* A connection may send many jobs one after another. Workers of the pool and CountingWorkspaces
+* are shared by all jobs, so a job does not pay for thread creation and histogram allocation.
+* */
+class CountingServer {
+private:
+    std::string socketPath;
+    CountingConfig jobDefaults;                             // engine, numa, direct io and temp dirs of every job
+    ThreadPool &threadPool;
+    int maxJobs;                                            // jobs counting at the same time, others wait for a workspace
+    std::vector<std::unique_ptr<CountingWorkspace>> workspaces;
+    std::vector<CountingWorkspace*> idleWorkspaces;
+    std::mutex workspaceMutex;
+    std::condition_variable workspaceCondition;
+    std::vector<int> connections;                           // open client sockets, shut down when server stops
+    std::mutex connectionMutex;
+    std::condition_variable connectionCondition;
+
+    CountingWorkspace *acquireWorkspace();
+    void releaseWorkspace(CountingWorkspace *workspace);
+    void serveConnection(int fd);
+    std::string runJob(const std::string &request);
+public:
+    CountingServer(const std::string &givenSocketPath, const CountingConfig &givenJobDefaults, ThreadPool &givenThreadPool, int givenMaxJobs);
+    int Run();                                              // serves until SIGINT or SIGTERM, returns exit status
+};
+
+int RunClient(const std::string &socketPath, const std::vector<CountingConfig> &jobs, std::ostream &out);  // prints results like a local run
+
+#endif
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+#include "shard.h"
+
+void WritePartialTopList(std::ostream &out, const PartialTopList &partial) {
+    out << "#shard " << partial.shardIndex << "/" << partial.shardCount << " " << partial.kmerSize << " " << partial.topCount << "\n";
+    for (size_t i = 0; i < partial.kmers.size(); i++)
+    {
+        out << partial.kmers[i].kmer << " " << partial.kmers[i].count << "\n";
+    }
+    out.flush();
+}
+
+PartialTopList ReadPartialTopList(std::istream &in, const std::string &name) {
+    PartialTopList partial;
+    std::string line;
+    if (!std::getline(in, line) ||
+        sscanf(line.c_str(), "#shard %d/%d %d %d", &partial.shardIndex, &partial.shardCount, &partial.kmerSize, &partial.topCount) != 4)
+    {
+        throw std::runtime_error(name + " is not a shard output");
+    }
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        KmerCount entry;
+        if (!(fields >> entry.kmer >> entry.count) || (int)entry.kmer.size() != partial.kmerSize)
+        {
+            throw std::runtime_error(name + " has a bad line: " + line);
+        }
+        partial.kmers.push_back(entry);
+    }
+    return partial;
+}
+
+/**
+* Function:	MergePartialTopLists(const std::vector<PartialTopList> &)
+* Checks that every shard of the same query is given once, then takes topcount most frequent kmers
+* of all shard toplists. Equal counts are ordered by kmer so the result does not depend on file order
+* */
+
+TopKmerList MergePartialTopLists(const std::vector<PartialTopList> &partials) {
+    if (partials.empty())
+    {
+        throw std::runtime_error("no shard outputs to merge");
+    }
+    const PartialTopList &first = partials[0];
+    std::vector<bool> seen(first.shardCount, false);
+    TopKmerList merged;
+    for (size_t i = 0; i < partials.size(); i++)
+    {
+        const PartialTopList &partial = partials[i];
+        if (partial.shardCount != first.shardCount || partial.kmerSize != first.kmerSize || partial.topCount != first.topCount)
+        {
+            throw std::runtime_error("shard outputs are from different queries");
+        }
+        if (partial.shardIndex < 0 || partial.shardIndex >= partial.shardCount || seen[partial.shardIndex])
+        {
+            throw std::runtime_error("shard " + std::to_string(partial.shardIndex) + " is given more than once or is out of range");
+        }
+        seen[partial.shardIndex] = true;
+        merged.insert(merged.end(), partial.kmers.begin(), partial.kmers.end());
+    }
+    for (int s = 0; s < first.shardCount; s++)
+    {
+        if (!seen[s])
+        {
+            throw std::runtime_error("shard " + std::to_string(s) + "/" + std::to_string(first.shardCount) + " is missing");
+        }
+    }
+
+    std::sort(merged.begin(), merged.end(), [](const KmerCount &x, const KmerCount &y)->bool {
+        return x.count != y.count ? x.count > y.count : x.kmer < y.kmer;
+    });
+    if ((int)merged.size() > first.topCount)
+    {
+        merged.resize(first.topCount);
+    }
+    return merged;
+}
@@ -0,0 +1,27 @@
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "mylib.h"
+
+/**
+* Toplist of one shard. Shards own disjoint partitions and every kmer has a single minimizer,
+* so each kmer is counted by exactly one shard and the global toplist is in the union of shard toplists.
+* File format is a header line "#shard i/n kmersize topcount" followed by "kmer count" lines.
+* */
+struct PartialTopList {
+    int shardIndex;
+    int shardCount;
+    int kmerSize;
+    int topCount;
+    TopKmerList kmers;
+};
+
+void WritePartialTopList(std::ostream &out, const PartialTopList &partial);
+PartialTopList ReadPartialTopList(std::istream &in, const std::string &name);   // throws std::runtime_error, name is for messages
+TopKmerList MergePartialTopLists(const std::vector<PartialTopList> &partials);  // throws std::runtime_error if shards are missing or do not match
+
+#endif
@@ -0,0 +1,440 @@
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+/* We are on Windows */
+#include <io.h>
+#include <malloc.h>
+#define O_DIRECT 0
+#define open _open
+#define close _close
+#define read _read
+
+#else
+
+/* We are on Non-Windows */
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SPILL_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#include "spillio.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+static std::mutex seekMutex;
+#endif
+
+static char *allocateAligned(size_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+    return (char *)_aligned_malloc(size, SPILLALIGNMENT);
+#else
+    void *ptr = NULL;
+    return (posix_memalign(&ptr, SPILLALIGNMENT, size) == 0) ? (char *)ptr : NULL;
+#endif
+}
+
+static void freeAligned(char *ptr) {
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/**
+* Function:	positionalWrite(int , const char *, size_t , uint64_t )
+* Writes all bytes at given offset, pwrite may write less than asked so it loops
+* */
+
+static bool positionalWrite(int fd, const char *data, size_t len, uint64_t offset) {
+    while (len > 0)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        int written;
+        {
+            std::lock_guard<std::mutex> lock(seekMutex);
+            _lseeki64(fd, offset, SEEK_SET);
+            written = _write(fd, data, (unsigned int)len);
+        }
+#else
+        ssize_t written = pwrite(fd, data, len, (off_t)offset);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+#endif
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        len -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool truncateFile(int fd, uint64_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+    return _chsize_s(fd, size) == 0;
+#else
+    return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
+
+
+#ifdef SPILL_HAVE_IO_URING
+/**
+* Minimal io_uring submission and completion queue on raw syscalls, liburing is not needed.
+* It is used by one thread only.
+* */
+class IoUringQueue {
+private:
+    int ringFd;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+public:
+    IoUringQueue() :ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes((struct io_uring_sqe *)MAP_FAILED) {}
+    ~IoUringQueue() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    bool Init(unsigned entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0)
+        {
+            return false;					// old kernel or not allowed, caller falls back to io threads
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqes = (struct io_uring_sqe *)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        sqTail = (unsigned *)((char *)sqRing + params.sq_off.tail);
+        sqMask = (unsigned *)((char *)sqRing + params.sq_off.ring_mask);
+        sqArray = (unsigned *)((char *)sqRing + params.sq_off.array);
+        cqHead = (unsigned *)((char *)cqRing + params.cq_off.head);
+        cqTail = (unsigned *)((char *)cqRing + params.cq_off.tail);
+        cqMask = (unsigned *)((char *)cqRing + params.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe *)((char *)cqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    bool SubmitWrite(int fd, const char *data, unsigned len, uint64_t offset, uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        struct io_uring_sqe *sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        int submitted;
+        do {
+            submitted = (int)syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0);
+        } while (submitted < 0 && errno == EINTR);
+        return submitted == 1;
+    }
+
+    // returns false if wait is false and there is no completion
+    bool Completion(bool wait, uint64_t &userData, int &result) {
+        for (;;)
+        {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            {
+                struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+                userData = cqe->user_data;
+                result = cqe->res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (!wait)
+            {
+                return false;
+            }
+            syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        }
+    }
+};
+#else
+class IoUringQueue {
+public:
+    bool Init(unsigned) { return false; }
+    bool SubmitWrite(int, const char *, unsigned, uint64_t, uint64_t) { return false; }
+    bool Completion(bool, uint64_t &, int &) { return false; }
+};
+#endif
+
+
+SpillWriter::SpillWriter(ThreadPool &givenIoPool, bool givenDirectIO)
+    :ioPool(givenIoPool), directIO(givenDirectIO), backend(SPILL_THREADS), ioFailed(false)
+{
+}
+
+SpillWriter::~SpillWriter() {
+    for (size_t p = 0; p < streams.size(); p++)
+    {
+        for (int b = 0; b < 2; b++) waitBuffer((int)p, b);
+        if (streams[p].fd >= 0) close(streams[p].fd);
+        freeAligned(streams[p].buffer[0]);
+        freeAligned(streams[p].buffer[1]);
+    }
+}
+
+/**
+* Function:	Open(const std::vector<std::string> &)
+* Creates one file and two aligned buffers per partition and picks io_uring if the kernel allows it.
+* O_DIRECT is dropped for a file whose filesystem refuses it (e.g. tmpfs).
+* */
+
+bool SpillWriter::Open(const std::vector<std::string> &paths) {
+    ring.reset(new IoUringQueue());
+    backend = ring->Init((unsigned)(paths.size() * 2)) ? SPILL_IO_URING : SPILL_THREADS;
+    if (backend == SPILL_THREADS)
+    {
+        ring.reset();
+    }
+
+    PartitionStream closedStream;
+    memset(&closedStream, 0, sizeof(closedStream));
+    closedStream.fd = -1;
+    streams.assign(paths.size(), closedStream);
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+        PartitionStream &stream = streams[p];
+        stream.buffer[0] = allocateAligned(SPILLBUFFERSIZE);
+        stream.buffer[1] = allocateAligned(SPILLBUFFERSIZE);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(_WIN32) || defined(_WIN64)
+        flags |= _O_BINARY;
+#endif
+        stream.fd = directIO ? open(paths[p].c_str(), flags | O_DIRECT, S_IRUSR | S_IWUSR) : -1;
+        if (stream.fd < 0)
+        {
+            stream.fd = open(paths[p].c_str(), flags, S_IRUSR | S_IWUSR);
+        }
+        if (stream.fd < 0 || stream.buffer[0] == NULL || stream.buffer[1] == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Function:	AppendLine(int , const char *, size_t )
+* Copies the superkmer and its newline into the active buffer, a record may continue in the next buffer
+* so that every buffer is written full
+* */
+
+void SpillWriter::AppendLine(int partNo, const char *data, size_t len) {
+    PartitionStream &stream = streams[partNo];
+    for (size_t i = 0; i <= len; )
+    {
+        if (stream.used == SPILLBUFFERSIZE)
+        {
+            submitBuffer(partNo, stream.active, SPILLBUFFERSIZE);
+            stream.active = 1 - stream.active;
+            waitBuffer(partNo, stream.active);
+            stream.used = 0;
+        }
+        if (i == len)
+        {
+            stream.buffer[stream.active][stream.used++] = '\n';
+            break;
+        }
+        size_t chunk = std::min(len - i, SPILLBUFFERSIZE - stream.used);
+        memcpy(stream.buffer[stream.active] + stream.used, data + i, chunk);
+        stream.used += chunk;
+        i += chunk;
+    }
+}
+
+void SpillWriter::submitBuffer(int partNo, int b, size_t len) {
+    PartitionStream &stream = streams[partNo];
+    uint64_t offset = stream.fileOffset;
+    stream.fileOffset += len;
+    stream.flightOffset[b] = offset;
+    stream.flightLen[b] = len;
+    {
+        std::lock_guard<std::mutex> lock(flightMutex);
+        stream.inFlight[b] = true;
+    }
+    if (backend == SPILL_IO_URING)
+    {
+        if (ring->SubmitWrite(stream.fd, stream.buffer[b], (unsigned)len, offset, ((uint64_t)partNo << 1) | b))
+        {
+            return;
+        }
+        writeDone(partNo, b, positionalWrite(stream.fd, stream.buffer[b], len, offset));
+        return;
+    }
+    int fd = stream.fd;
+    const char *data = stream.buffer[b];
+    ioPool.Submit([this, partNo, b, fd, data, len, offset] {
+        this->writeDone(partNo, b, positionalWrite(fd, data, len, offset));
+    });
+}
+
+void SpillWriter::writeDone(int partNo, int b, bool ok) {
+    std::lock_guard<std::mutex> lock(flightMutex);
+    streams[partNo].inFlight[b] = false;
+    ioFailed = ioFailed || !ok;
+    flightCondition.notify_all();
+}
+
+/**
+* Function:	reapCompletions(bool )
+* Handles io_uring completions. The rest of a short or failed write (e.g. a kernel without
+* IORING_OP_WRITE) is written synchronously.
+* */
+
+void SpillWriter::reapCompletions(bool wait) {
+    uint64_t userData;
+    int result;
+    while (ring->Completion(wait, userData, result))
+    {
+        int partNo = (int)(userData >> 1);
+        int b = (int)(userData & 1);
+        PartitionStream &stream = streams[partNo];
+        size_t done = (result > 0) ? (size_t)result : 0;
+        bool ok = true;
+        if (done < stream.flightLen[b])
+        {
+            ok = positionalWrite(stream.fd, stream.buffer[b] + done, stream.flightLen[b] - done, stream.flightOffset[b] + done);
+        }
+        writeDone(partNo, b, ok);
+        wait = false;
+    }
+}
+
+void SpillWriter::waitBuffer(int partNo, int b) {
+    if (backend == SPILL_IO_URING)
+    {
+        while (streams[partNo].inFlight[b])
+        {
+            reapCompletions(true);
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> lock(flightMutex);
+    flightCondition.wait(lock, [this, partNo, b] { return !this->streams[partNo].inFlight[b]; });
+}
+
+/**
+* Function:	Close()
+* Writes the last buffer of every partition. With O_DIRECT it is padded to alignment and the
+* file is truncated back to its real size.
+* */
+
+bool SpillWriter::Close() {
+    for (size_t p = 0; p < streams.size(); p++)
+    {
+        PartitionStream &stream = streams[p];
+        waitBuffer((int)p, 1 - stream.active);
+        uint64_t fileSize = stream.fileOffset + stream.used;
+        size_t writeLen = stream.used;
+        if (directIO)
+        {
+            writeLen = (stream.used + SPILLALIGNMENT - 1) / SPILLALIGNMENT * SPILLALIGNMENT;
+            memset(stream.buffer[stream.active] + stream.used, 0, writeLen - stream.used);
+        }
+        if (writeLen > 0)
+        {
+            submitBuffer((int)p, stream.active, writeLen);
+            waitBuffer((int)p, stream.active);
+        }
+        if (writeLen != stream.used && !truncateFile(stream.fd, fileSize))
+        {
+            ioFailed = true;
+        }
+        stream.used = 0;
+        close(stream.fd);
+        stream.fd = -1;
+    }
+    return !ioFailed;
+}
+
+
+/**
+* Function:	LoadSpillFile(const std::string &)
+* Reads a whole partition file into memory with large reads
+* */
+
+std::vector<char> LoadSpillFile(const std::string &path) {
+    std::vector<char> data;
+    int flags = O_RDONLY;
+#if defined(_WIN32) || defined(_WIN64)
+    flags |= _O_BINARY;
+#endif
+    int fd = open(path.c_str(), flags);
+    if (fd < 0)
+    {
+        return data;
+    }
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) == 0 && fileInfo.st_size > 0)
+    {
+#if defined(__linux__)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        data.resize((size_t)fileInfo.st_size);
+        size_t done = 0;
+        while (done < data.size())
+        {
+            size_t chunk = std::min(data.size() - done, (size_t)1 << 24);
+            int got = (int)read(fd, data.data() + done, (unsigned int)chunk);
+            if (got <= 0)
+            {
+                break;
+            }
+            done += got;
+        }
+        data.resize(done);
+    }
+    close(fd);
+    return data;
+}
+
+/**
+* Function:	LoadSpillFileAsync(ThreadPool &, const std::string &)
+* Starts loading a partition file on an io thread, used to read the next partition
+* while the current one is counted
+* */
+
+std::future<std::vector<char>> LoadSpillFileAsync(ThreadPool &ioPool, const std::string &path) {
+    std::shared_ptr<std::promise<std::vector<char>>> loaded(new std::promise<std::vector<char>>());
+    ioPool.Submit([loaded, path] { loaded->set_value(LoadSpillFile(path)); });
+    return loaded->get_future();
+}
@@ -0,0 +1,68 @@
+#ifndef __SPILLIO_H__
+#define __SPILLIO_H__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <cstdint>
+
+#include "threadpool.h"
+
+const size_t SPILLBUFFERSIZE = 1 << 18;                     // 256kb per buffer, two buffers per partition
+const size_t SPILLALIGNMENT = 4096;                         // O_DIRECT needs aligned buffers, sizes and offsets
+
+enum SpillBackend {
+    SPILL_IO_URING,                                         // full buffers are queued to io_uring by the partitioning thread
+    SPILL_THREADS                                           // full buffers are written by io threads with pwrite
+};
+
+class IoUringQueue;
+
+/**
+* Double buffered writer of partition files for disk method.
+* Superkmers are appended to the active buffer of their partition, a full buffer is
+* written in the background while the other one is being filled. Every write but the last
+* one of a file is exactly SPILLBUFFERSIZE bytes at an aligned offset, so files can be opened with O_DIRECT.
+* Only one thread may append.
+* */
+class SpillWriter {
+private:
+    struct PartitionStream {
+        int fd;
+        char *buffer[2];
+        size_t used;                                        // bytes in active buffer
+        int active;                                         // buffer being filled
+        bool inFlight[2];
+        uint64_t flightOffset[2];                           // file offset and length of write in flight
+        size_t flightLen[2];
+        uint64_t fileOffset;                                // offset of next buffer in file
+    };
+    ThreadPool &ioPool;
+    bool directIO;
+    SpillBackend backend;
+    std::unique_ptr<IoUringQueue> ring;
+    std::vector<PartitionStream> streams;
+    std::mutex flightMutex;                                 // inFlight flags are cleared by io threads
+    std::condition_variable flightCondition;
+    bool ioFailed;
+
+    void submitBuffer(int partNo, int b, size_t len);
+    void waitBuffer(int partNo, int b);
+    void reapCompletions(bool wait);
+    void writeDone(int partNo, int b, bool ok);
+public:
+    SpillWriter(ThreadPool &givenIoPool, bool givenDirectIO);
+    ~SpillWriter();
+    bool Open(const std::vector<std::string> &paths);       // one file per partition
+    void AppendLine(int partNo, const char *data, size_t len);  // appends data and '\n'
+    bool Close();                                           // flushes everything, false if a write failed
+    SpillBackend Backend() const { return backend; }
+};
+
+std::vector<char> LoadSpillFile(const std::string &path);
+std::future<std::vector<char>> LoadSpillFileAsync(ThreadPool &ioPool, const std::string &path);  // read-ahead of a partition file
+
+#endif
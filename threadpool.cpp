@@ -0,0 +1,278 @@
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(_WIN32) || defined(_WIN64)
+/* We are on Windows */
+#include <windows.h>
+
+#else
+
+/* We are on Non-Windows */
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif
+
+#include "threadpool.h"
+
+static thread_local int currentWorkerNode = -1;
+
+ThreadPool::ThreadPool(int threadCount, bool givenPinThreads)
+    :stopping(false), pinThreads(givenPinThreads)
+{
+    if (threadCount < 1)
+    {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount < 1)
+    {
+        threadCount = 1;				// hardware_concurrency may return 0 if it is not computable
+    }
+    readTopology();
+    for (int i = 0; i < threadCount; i++)
+    {
+        workers.push_back(std::thread([this, i] { this->workerLoop(i); }));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+int ThreadPool::CurrentNode() {
+    return currentWorkerNode;
+}
+
+/**
+* Function:	Run(int , const std::function<void(int)> &)
+* Queues task(0) ... task(taskCount-1) and blocks until all of them are finished.
+* Different callers may run at the same time, their tasks share the workers.
+* If a task throws, the first exception is rethrown in the caller after all tasks are finished.
+* */
+
+void ThreadPool::Run(int taskCount, const std::function<void(int)> &task) {
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    int remaining = taskCount;
+    std::exception_ptr firstError;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (int i = 0; i < taskCount; i++)
+        {
+            tasks.push_back([&task, &doneMutex, &doneCondition, &remaining, &firstError, i] {
+                std::exception_ptr error;
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (error && !firstError)
+                {
+                    firstError = error;
+                }
+                if (--remaining == 0)
+                {
+                    doneCondition.notify_all();
+                }
+            });
+        }
+    }
+    queueCondition.notify_all();
+
+    std::unique_lock<std::mutex> doneLock(doneMutex);
+    doneCondition.wait(doneLock, [&remaining] { return remaining == 0; });
+    if (firstError)
+    {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void ThreadPool::Submit(const std::function<void()> &task) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        tasks.push_back(task);
+    }
+    queueCondition.notify_one();
+}
+
+void ThreadPool::workerLoop(int workerNo) {
+    if (pinThreads)
+    {
+        // worker i goes to node i % nodes so that consecutive workers are spread over sockets
+        int node = NodeId(workerNo % NodeCount());
+        const std::vector<int> &cpus = nodeCpus[node];
+        int cpu = cpus[(workerNo / NodeCount()) % cpus.size()];
+#if defined(_WIN32) || defined(_WIN64)
+        if (cpu < 64)
+        {
+            SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpu);
+        }
+        currentWorkerNode = node;
+#else
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0)
+        {
+            currentWorkerNode = node;
+        }
+#endif
+    }
+
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+/**
+* Function:	readTopology()
+* Reads cpus of each NUMA node from sysfs, keeping only cpus this process may run on.
+* Without sysfs (or on Windows) all cpus are put into a single node.
+* */
+
+void ThreadPool::readTopology() {
+    nodeCpus.clear();
+    usableNodes.clear();
+#if !defined(_WIN32) && !defined(_WIN64)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAllowed = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    char path[100];
+    for (int node = 0; ; node++)
+    {
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        std::ifstream cpuListFile(path);
+        std::string cpuList;
+        if (!cpuListFile || !std::getline(cpuListFile, cpuList))
+        {
+            break;
+        }
+        std::vector<int> cpus;
+        const char *p = cpuList.c_str();
+        while (*p)
+        {
+            char *end;
+            long first = strtol(p, &end, 10);
+            long last = first;
+            if (end == p)
+            {
+                break;
+            }
+            if (*end == '-')
+            {
+                p = end + 1;
+                last = strtol(p, &end, 10);
+            }
+            for (long cpu = first; cpu <= last; cpu++)
+            {
+                if (!haveAllowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                {
+                    cpus.push_back((int)cpu);
+                }
+            }
+            p = (*end == ',') ? end + 1 : end;
+        }
+        nodeCpus.push_back(cpus);
+        if (!cpus.empty())
+        {
+            usableNodes.push_back(node);				// nodes without usable cpus cannot host a worker
+        }
+    }
+#endif
+    if (usableNodes.empty())
+    {
+        int cpuCount = std::thread::hardware_concurrency();
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < (cpuCount > 0 ? cpuCount : 1); cpu++) cpus.push_back(cpu);
+        nodeCpus.assign(1, cpus);
+        usableNodes.assign(1, 0);
+    }
+}
+
+
+/**
+* Function:	AllocateOnNode(size_t , int )
+* Maps anonymous memory and asks the kernel to prefer given node for its pages.
+* mbind is only a hint here, if it fails (e.g. not allowed in a container) memory is still usable.
+* */
+
+void *AllocateOnNode(size_t size, int node) {
+#if defined(_WIN32) || defined(_WIN64)
+    (void)node;
+    return malloc(size);
+#else
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (node >= 0 && node < 1024)
+    {
+        const int bitsPerWord = 8 * sizeof(unsigned long);
+        unsigned long nodeMask[1024 / (8 * sizeof(unsigned long))] = { 0 };
+        nodeMask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+        syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, nodeMask, (unsigned long)1024, 0);
+    }
+    return ptr;
+#endif
+}
+
+/**
+* Function:	ReallocateOnNode(void *, size_t , size_t , int )
+* Grows memory given by AllocateOnNode, mremap keeps the node policy of the mapping
+* */
+
+void *ReallocateOnNode(void *ptr, size_t oldSize, size_t newSize, int node) {
+    if (ptr == NULL)
+    {
+        return AllocateOnNode(newSize, node);
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    (void)oldSize;
+    return realloc(ptr, newSize);
+#else
+    void *newPtr = mremap(ptr, oldSize, newSize, MREMAP_MAYMOVE);
+    return (newPtr == MAP_FAILED) ? NULL : newPtr;
+#endif
+}
+
+void FreeOnNode(void *ptr, size_t size) {
+    if (ptr == NULL)
+    {
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    (void)size;
+    free(ptr);
+#else
+    munmap(ptr, size);
+#endif
+}
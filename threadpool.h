@@ -0,0 +1,53 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstddef>
+
+enum NumaPlacement {
+    NUMA_OFF,                                               // memory is where the OS puts it
+    NUMA_FIRST_TOUCH,                                       // counting thread copies its partition buffer before counting
+    NUMA_EXPLICIT                                           // partition buffers are bound to the node of the threads counting them
+};
+
+/**
+* Persistent worker threads shared by all counting phases.
+* If pinning is enabled, worker i is pinned to a core of node i % NodeCount(),
+* so workers are spread over sockets and each worker knows its NUMA node.
+* */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping;
+    bool pinThreads;
+    std::vector<std::vector<int>> nodeCpus;                 // cpus of each NUMA node, single node if topology is unknown
+    std::vector<int> usableNodes;                           // nodes having cpus this process may run on
+
+    void workerLoop(int workerNo);
+    void readTopology();
+public:
+    ThreadPool(int threadCount, bool givenPinThreads);
+    ~ThreadPool();
+    int Size() const { return (int)workers.size(); }
+    int NodeCount() const { return (int)usableNodes.size(); }
+    int NodeId(int index) const { return usableNodes[index]; }
+    bool IsPinned() const { return pinThreads; }
+    void Run(int taskCount, const std::function<void(int)> &task);  // runs task(0..taskCount-1) and waits, do not call from a task, rethrows first error
+    void Submit(const std::function<void()> &task);         // queues task and returns immediately
+    static int CurrentNode();                               // node of the calling worker, -1 if it is not a pinned worker
+};
+
+void *AllocateOnNode(size_t size, int node);                // page backed memory preferring given node
+void *ReallocateOnNode(void *ptr, size_t oldSize, size_t newSize, int node);
+void FreeOnNode(void *ptr, size_t size);
+
+#endif